@@ -72,7 +72,7 @@ Box box( Sample s, double width = 0.5 )
     double wing = (1 - width) / 2;
     result.low = s[ int( floor( s.size() * wing ) ) ];
     result.median = s[ s.size() / 2 ];
-    result.high = s[ int( ceil( s.size() * (1 - wing) ) ) ];
+    result.high = s[ std::min( int( ceil( s.size() * (1 - wing) ) ), int( s.size() ) - 1 ) ];
     return result;
 }
 
@@ -98,7 +98,7 @@ template< typename E >
 Sample bootstrap( Sample s, E estimator, int iterations = 20000 )
 {
     std::mt19937 rand;
-    std::uniform_int_distribution<> dist( 0, s.size() );
+    std::uniform_int_distribution<> dist( 0, s.size() - 1 );
 
     Sample result;
     for ( int i = 0; i < iterations; ++i ) {
@@ -224,10 +224,12 @@ struct ResultLog {
     std::map< Key, Value > map;
     Key last;
 
+    std::string path;
+
     void append( Key k, Value value )
     {
         if ( !log.is_open() )
-            log.open( "benchmark.log", std::ofstream::out | std::ofstream::app );
+            log.open( path, std::ofstream::out | std::ofstream::app );
         if ( last.benchmark != k.benchmark )
             log << k.benchmark << std::endl;
 
@@ -241,10 +243,10 @@ struct ResultLog {
     bool has( Key k ) { return map.count( k ); }
     Value get( Key k ) { return map[ k ]; }
 
-    ResultLog()
+    ResultLog( std::string path = "benchmark.log" ) : path( path )
     {
         try {
-            std::ifstream ifs( "benchmark.log" );
+            std::ifstream ifs( path );
             char linebuf[4096];
             while ( ifs.good() && !ifs.eof() ) {
                 ifs.getline(linebuf, 4096);
@@ -96,6 +96,15 @@ namespace jenkins {
 // - pairs are used instead of output parameters
 // - some functions were marked explicitly for inlining with gcc attribete
 //   as they are considered too long otherwise
+// - the mixing functions are templates, so that they also run on vectors
+//   of lanes for batches of messages (see Hash128 for batches)
+
+#ifdef __GNUC__
+// vectors of N 64-bit lanes, AVX2 registers hold 4 of them
+template< int N > struct SpookyLanes;
+template<> struct SpookyLanes< 4 > { typedef uint64 Type __attribute__(( vector_size( 32 ) )); };
+template<> struct SpookyLanes< 8 > { typedef uint64 Type __attribute__(( vector_size( 64 ) )); };
+#endif
 
 class SpookyHash
 {
@@ -162,6 +171,72 @@ public:
         return std::make_pair( h0, h1 );
     }
 
+    //
+    // Hash128: hash N messages of the same length in one call, N is 4 or 8
+    //
+    // Every step is done for all of the messages at once, each one in its
+    // lane of a vector, which the compiler maps to AVX2 (or SSE2) registers.
+    // The results are the same as those of Hash128 for each message; a
+    // compiler without vector extensions hashes the messages one by one.
+    //
+    template< int N >
+    static INLINE void Hash128(
+        const void *const *messages,          // N messages
+        size_t length,                        // length of each message in bytes
+        uint64 seed1,                         // seed 1 of each message
+        uint64 seed2,                         // seed 2 of each message
+        std::pair< uint64, uint64 > *hashes)  // out: N hash values
+    {
+        static_assert( N == 4 || N == 8, "batches of 4 or 8 messages" );
+#ifdef __GNUC__
+        typedef typename SpookyLanes< N >::Type Lanes;
+        if (length < sc_bufSize)
+        {
+            ShortLanes< Lanes >(messages, length, seed1, seed2, hashes);
+            return;
+        }
+
+        Lanes h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11;
+        Lanes data[sc_numVars];
+        size_t offset = 0;
+
+        Splat(h0, seed1);
+        Splat(h1, seed2);
+        Splat(h2, sc_const);
+        h3=h6=h9  = h0;
+        h4=h7=h10 = h1;
+        h5=h8=h11 = h2;
+
+        // handle all whole sc_blockSize blocks of bytes
+        for (; offset + sc_blockSize <= length; offset += sc_blockSize)
+        {
+            for (size_t j = 0; j < sc_numVars; ++j)
+                Gather(data[j], messages, offset + 8*j);
+            Mix(data, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
+        }
+
+        // handle the last partial block of sc_blockSize bytes
+        size_t remainder = length - offset;
+        for (int i = 0; i < N; ++i)
+        {
+            uint64 buf[sc_numVars];
+            memcpy(buf, reinterpret_cast< const uint8 * >( messages[i] ) + offset, remainder);
+            memset( reinterpret_cast< uint8 * >( buf )+remainder, 0, sc_blockSize-remainder);
+            reinterpret_cast< uint8 * >( buf )[sc_blockSize-1] = remainder;
+            for (size_t j = 0; j < sc_numVars; ++j)
+                data[j][i] = buf[j];
+        }
+
+        // do some final mixing
+        End(data, h0,h1,h2,h3,h4,h5,h6,h7,h8,h9,h10,h11);
+        for (int i = 0; i < N; ++i)
+            hashes[i] = std::make_pair( h0[i], h1[i] );
+#else
+        for (int i = 0; i < N; ++i)
+            hashes[i] = Hash128(messages[i], length, seed1, seed2);
+#endif
+    }
+
     //
     // Hash64: hash a single message in one call, return 64-bit output
     //
@@ -364,6 +439,16 @@ public:
         return (x << k) | (x >> (64 - k));
     }
 
+    //
+    // rotate in place, which also works on vectors of lanes (returning
+    // those from a function depends on the ABI)
+    //
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void Rot(W &x, int k)
+    {
+        x = (x << k) | (x >> (64 - k));
+    }
+
     //
     // This is used if the input is 96 bytes long or longer.
     //
@@ -377,24 +462,25 @@ public:
     //   When run forward or backwards one Mix
     // I tried 3 pairs of each; they all differed by at least 212 bits.
     //
-    static INLINE void Mix(
-        const uint64 *data,
-        uint64 &s0, uint64 &s1, uint64 &s2, uint64 &s3,
-        uint64 &s4, uint64 &s5, uint64 &s6, uint64 &s7,
-        uint64 &s8, uint64 &s9, uint64 &s10,uint64 &s11) __attribute__((always_inline))
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void Mix(
+        const W *data,
+        W &s0, W &s1, W &s2, W &s3,
+        W &s4, W &s5, W &s6, W &s7,
+        W &s8, W &s9, W &s10,W &s11)
     {
-      s0 += data[0];    s2 ^= s10;    s11 ^= s0;    s0 = Rot64(s0,11);    s11 += s1;
-      s1 += data[1];    s3 ^= s11;    s0 ^= s1;    s1 = Rot64(s1,32);    s0 += s2;
-      s2 += data[2];    s4 ^= s0;    s1 ^= s2;    s2 = Rot64(s2,43);    s1 += s3;
-      s3 += data[3];    s5 ^= s1;    s2 ^= s3;    s3 = Rot64(s3,31);    s2 += s4;
-      s4 += data[4];    s6 ^= s2;    s3 ^= s4;    s4 = Rot64(s4,17);    s3 += s5;
-      s5 += data[5];    s7 ^= s3;    s4 ^= s5;    s5 = Rot64(s5,28);    s4 += s6;
-      s6 += data[6];    s8 ^= s4;    s5 ^= s6;    s6 = Rot64(s6,39);    s5 += s7;
-      s7 += data[7];    s9 ^= s5;    s6 ^= s7;    s7 = Rot64(s7,57);    s6 += s8;
-      s8 += data[8];    s10 ^= s6;    s7 ^= s8;    s8 = Rot64(s8,55);    s7 += s9;
-      s9 += data[9];    s11 ^= s7;    s8 ^= s9;    s9 = Rot64(s9,54);    s8 += s10;
-      s10 += data[10];    s0 ^= s8;    s9 ^= s10;    s10 = Rot64(s10,22);    s9 += s11;
-      s11 += data[11];    s1 ^= s9;    s10 ^= s11;    s11 = Rot64(s11,46);    s10 += s0;
+      s0 += data[0];    s2 ^= s10;    s11 ^= s0;    Rot(s0,11);    s11 += s1;
+      s1 += data[1];    s3 ^= s11;    s0 ^= s1;    Rot(s1,32);    s0 += s2;
+      s2 += data[2];    s4 ^= s0;    s1 ^= s2;    Rot(s2,43);    s1 += s3;
+      s3 += data[3];    s5 ^= s1;    s2 ^= s3;    Rot(s3,31);    s2 += s4;
+      s4 += data[4];    s6 ^= s2;    s3 ^= s4;    Rot(s4,17);    s3 += s5;
+      s5 += data[5];    s7 ^= s3;    s4 ^= s5;    Rot(s5,28);    s4 += s6;
+      s6 += data[6];    s8 ^= s4;    s5 ^= s6;    Rot(s6,39);    s5 += s7;
+      s7 += data[7];    s9 ^= s5;    s6 ^= s7;    Rot(s7,57);    s6 += s8;
+      s8 += data[8];    s10 ^= s6;    s7 ^= s8;    Rot(s8,55);    s7 += s9;
+      s9 += data[9];    s11 ^= s7;    s8 ^= s9;    Rot(s9,54);    s8 += s10;
+      s10 += data[10];    s0 ^= s8;    s9 ^= s10;    Rot(s10,22);    s9 += s11;
+      s11 += data[11];    s1 ^= s9;    s10 ^= s11;    Rot(s11,46);    s10 += s0;
     }
 
     //
@@ -413,30 +499,32 @@ public:
     // Two iterations was almost good enough for a 64-bit result, but a
     // 128-bit result is reported, so End() does three iterations.
     //
-    static INLINE void EndPartial(
-        uint64 &h0, uint64 &h1, uint64 &h2, uint64 &h3,
-        uint64 &h4, uint64 &h5, uint64 &h6, uint64 &h7,
-        uint64 &h8, uint64 &h9, uint64 &h10,uint64 &h11) __attribute__((always_inline))
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void EndPartial(
+        W &h0, W &h1, W &h2, W &h3,
+        W &h4, W &h5, W &h6, W &h7,
+        W &h8, W &h9, W &h10,W &h11)
     {
-        h11+= h1;    h2 ^= h11;   h1 = Rot64(h1,44);
-        h0 += h2;    h3 ^= h0;    h2 = Rot64(h2,15);
-        h1 += h3;    h4 ^= h1;    h3 = Rot64(h3,34);
-        h2 += h4;    h5 ^= h2;    h4 = Rot64(h4,21);
-        h3 += h5;    h6 ^= h3;    h5 = Rot64(h5,38);
-        h4 += h6;    h7 ^= h4;    h6 = Rot64(h6,33);
-        h5 += h7;    h8 ^= h5;    h7 = Rot64(h7,10);
-        h6 += h8;    h9 ^= h6;    h8 = Rot64(h8,13);
-        h7 += h9;    h10^= h7;    h9 = Rot64(h9,38);
-        h8 += h10;   h11^= h8;    h10= Rot64(h10,53);
-        h9 += h11;   h0 ^= h9;    h11= Rot64(h11,42);
-        h10+= h0;    h1 ^= h10;   h0 = Rot64(h0,54);
-    }
-
-    static INLINE void End(
-        const uint64 *data,
-        uint64 &h0, uint64 &h1, uint64 &h2, uint64 &h3,
-        uint64 &h4, uint64 &h5, uint64 &h6, uint64 &h7,
-        uint64 &h8, uint64 &h9, uint64 &h10,uint64 &h11) __attribute__((always_inline))
+        h11+= h1;    h2 ^= h11;   Rot(h1,44);
+        h0 += h2;    h3 ^= h0;    Rot(h2,15);
+        h1 += h3;    h4 ^= h1;    Rot(h3,34);
+        h2 += h4;    h5 ^= h2;    Rot(h4,21);
+        h3 += h5;    h6 ^= h3;    Rot(h5,38);
+        h4 += h6;    h7 ^= h4;    Rot(h6,33);
+        h5 += h7;    h8 ^= h5;    Rot(h7,10);
+        h6 += h8;    h9 ^= h6;    Rot(h8,13);
+        h7 += h9;    h10^= h7;    Rot(h9,38);
+        h8 += h10;   h11^= h8;    Rot(h10,53);
+        h9 += h11;   h0 ^= h9;    Rot(h11,42);
+        h10+= h0;    h1 ^= h10;   Rot(h0,54);
+    }
+
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void End(
+        const W *data,
+        W &h0, W &h1, W &h2, W &h3,
+        W &h4, W &h5, W &h6, W &h7,
+        W &h8, W &h9, W &h10,W &h11)
     {
         h0 += data[0];   h1 += data[1];   h2 += data[2];   h3 += data[3];
         h4 += data[4];   h5 += data[5];   h6 += data[6];   h7 += data[7];
@@ -461,20 +549,21 @@ public:
     // with diffs defined by either xor or subtraction
     // with a base of all zeros plus a counter, or plus another bit, or random
     //
-    static INLINE void ShortMix(uint64 &h0, uint64 &h1, uint64 &h2, uint64 &h3) __attribute__((always_inline))
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void ShortMix(W &h0, W &h1, W &h2, W &h3)
     {
-        h2 = Rot64(h2,50);  h2 += h3;  h0 ^= h2;
-        h3 = Rot64(h3,52);  h3 += h0;  h1 ^= h3;
-        h0 = Rot64(h0,30);  h0 += h1;  h2 ^= h0;
-        h1 = Rot64(h1,41);  h1 += h2;  h3 ^= h1;
-        h2 = Rot64(h2,54);  h2 += h3;  h0 ^= h2;
-        h3 = Rot64(h3,48);  h3 += h0;  h1 ^= h3;
-        h0 = Rot64(h0,38);  h0 += h1;  h2 ^= h0;
-        h1 = Rot64(h1,37);  h1 += h2;  h3 ^= h1;
-        h2 = Rot64(h2,62);  h2 += h3;  h0 ^= h2;
-        h3 = Rot64(h3,34);  h3 += h0;  h1 ^= h3;
-        h0 = Rot64(h0,5);   h0 += h1;  h2 ^= h0;
-        h1 = Rot64(h1,36);  h1 += h2;  h3 ^= h1;
+        Rot(h2,50);  h2 += h3;  h0 ^= h2;
+        Rot(h3,52);  h3 += h0;  h1 ^= h3;
+        Rot(h0,30);  h0 += h1;  h2 ^= h0;
+        Rot(h1,41);  h1 += h2;  h3 ^= h1;
+        Rot(h2,54);  h2 += h3;  h0 ^= h2;
+        Rot(h3,48);  h3 += h0;  h1 ^= h3;
+        Rot(h0,38);  h0 += h1;  h2 ^= h0;
+        Rot(h1,37);  h1 += h2;  h3 ^= h1;
+        Rot(h2,62);  h2 += h3;  h0 ^= h2;
+        Rot(h3,34);  h3 += h0;  h1 ^= h3;
+        Rot(h0,5);   h0 += h1;  h2 ^= h0;
+        Rot(h1,36);  h1 += h2;  h3 ^= h1;
     }
 
     //
@@ -489,19 +578,20 @@ public:
     // For every pair of input bits,
     // with probability 50 +- .75% (the worst case is approximately that)
     //
-    static INLINE void ShortEnd(uint64 &h0, uint64 &h1, uint64 &h2, uint64 &h3) __attribute__((always_inline))
+    template< typename W >
+    static INLINE __attribute__((always_inline)) void ShortEnd(W &h0, W &h1, W &h2, W &h3)
     {
-        h3 ^= h2;  h2 = Rot64(h2,15);  h3 += h2;
-        h0 ^= h3;  h3 = Rot64(h3,52);  h0 += h3;
-        h1 ^= h0;  h0 = Rot64(h0,26);  h1 += h0;
-        h2 ^= h1;  h1 = Rot64(h1,51);  h2 += h1;
-        h3 ^= h2;  h2 = Rot64(h2,28);  h3 += h2;
-        h0 ^= h3;  h3 = Rot64(h3,9);   h0 += h3;
-        h1 ^= h0;  h0 = Rot64(h0,47);  h1 += h0;
-        h2 ^= h1;  h1 = Rot64(h1,54);  h2 += h1;
-        h3 ^= h2;  h2 = Rot64(h2,32);  h3 += h2;
-        h0 ^= h3;  h3 = Rot64(h3,25);  h0 += h3;
-        h1 ^= h0;  h0 = Rot64(h0,63);  h1 += h0;
+        h3 ^= h2;  Rot(h2,15);  h3 += h2;
+        h0 ^= h3;  Rot(h3,52);  h0 += h3;
+        h1 ^= h0;  Rot(h0,26);  h1 += h0;
+        h2 ^= h1;  Rot(h1,51);  h2 += h1;
+        h3 ^= h2;  Rot(h2,28);  h3 += h2;
+        h0 ^= h3;  Rot(h3,9);   h0 += h3;
+        h1 ^= h0;  Rot(h0,47);  h1 += h0;
+        h2 ^= h1;  Rot(h1,54);  h2 += h1;
+        h3 ^= h2;  Rot(h2,32);  h3 += h2;
+        h0 ^= h3;  Rot(h3,25);  h0 += h3;
+        h1 ^= h0;  Rot(h0,63);  h1 += h0;
     }
 
 private:
@@ -569,6 +659,30 @@ private:
 
         // Handle the last 0..15 bytes, and its length
         d += uint64( length ) << 56;
+        ShortTail(u.p8, remainder, c, d);
+        ShortEnd(a,b,c,d);
+
+        return std::make_pair( a, b );
+    }
+
+    //
+    // ShortTail: add the last 0..15 bytes of a short message to c and d
+    //
+    static INLINE void ShortTail(
+        const uint8 *tail,  // the bytes after the last whole 16 or 32
+        size_t remainder,   // their count
+        uint64 &c,
+        uint64 &d)
+        __attribute__((always_inline))
+    {
+        union
+        {
+            const uint8 *p8;
+            const uint32 *p32;
+            const uint64 *p64;
+        } u;
+
+        u.p8 = tail;
         switch (remainder)
         {
         case 15:
@@ -610,11 +724,91 @@ private:
             c += sc_const;
             d += sc_const;
         }
+    }
+
+#ifdef __GNUC__
+    //
+    // Short for a batch of messages, see Hash128 for batches
+    //
+    template< typename Lanes >
+    static INLINE __attribute__((always_inline)) void ShortLanes(
+        const void *const *messages,
+        size_t length,
+        uint64 seed1,
+        uint64 seed2,
+        std::pair< uint64, uint64 > *hashes)
+    {
+        size_t remainder = length%32;
+        size_t offset = 0;
+        Lanes a, b, c, d, w = Lanes();
+        Splat(a, seed1);
+        Splat(b, seed2);
+        Splat(c, sc_const);
+        Splat(d, sc_const);
+
+        if (length > 15)
+        {
+            // handle all complete sets of 32 bytes
+            for (; offset + 32 <= length; offset += 32)
+            {
+                Gather(w, messages, offset);      c += w;
+                Gather(w, messages, offset + 8);  d += w;
+                ShortMix(a,b,c,d);
+                Gather(w, messages, offset + 16); a += w;
+                Gather(w, messages, offset + 24); b += w;
+            }
+
+            //Handle the case of 16+ remaining bytes.
+            if (remainder >= 16)
+            {
+                Gather(w, messages, offset);      c += w;
+                Gather(w, messages, offset + 8);  d += w;
+                ShortMix(a,b,c,d);
+                offset += 16;
+                remainder -= 16;
+            }
+        }
+
+        // Handle the last 0..15 bytes, and its length
+        Splat(w, uint64( length ) << 56);
+        d += w;
+        for (size_t i = 0; i < Width< Lanes >(); ++i)
+        {
+            uint64 tc = 0, td = 0;
+            ShortTail(reinterpret_cast< const uint8 * >( messages[i] ) + offset, remainder, tc, td);
+            c[i] += tc;
+            d[i] += td;
+        }
         ShortEnd(a,b,c,d);
 
-        return std::make_pair( a, b );
+        for (size_t i = 0; i < Width< Lanes >(); ++i)
+            hashes[i] = std::make_pair( a[i], b[i] );
+    }
+
+    template< typename Lanes >
+    static constexpr size_t Width() { return sizeof( Lanes ) / sizeof( uint64 ); }
+
+    // vectors are passed by reference, returning them depends on the ABI
+    template< typename Lanes >
+    static INLINE __attribute__((always_inline)) void Splat(Lanes &v, uint64 x)
+    {
+        for (size_t i = 0; i < Width< Lanes >(); ++i)
+            v[i] = x;
     }
 
+    // the word at offset of each message, the messages need not be aligned
+    template< typename Lanes >
+    static INLINE __attribute__((always_inline)) void Gather(Lanes &v, const void *const *messages, size_t offset)
+    {
+        for (size_t i = 0; i < Width< Lanes >(); ++i)
+        {
+            uint64 w;
+            memcpy(&w, reinterpret_cast< const uint8 * >( messages[i] ) + offset, sizeof( w ));
+            v[i] = w;
+        }
+    }
+#endif
+
     // number of uint64's in internal state
     static const size_t sc_numVars = 12;
 
@@ -668,6 +862,22 @@ inline hash128_t spooky( const void *message, size_t length, uint64_t seed1, uin
     return jenkins::SpookyHash::Hash128( message, length, seed1, seed2 );
 }
 
+/* hashes[ i ] = spooky( messages[ i ], length, seed1, seed2 ) for all i < count */
+inline void spooky( const void *const *messages, size_t count, size_t length,
+                    uint64_t seed1, uint64_t seed2, hash128_t *hashes )
+{
+#ifdef __AVX512F__
+    const size_t batch = 8;
+#else
+    const size_t batch = 4;
+#endif
+    size_t i = 0;
+    for ( ; i + batch <= count; i += batch )
+        jenkins::SpookyHash::Hash128< batch >( messages + i, length, seed1, seed2, hashes + i );
+    for ( ; i < count; ++i )
+        hashes[ i ] = spooky( messages[ i ], length, seed1, seed2 );
+}
+
 }
 
 }
@@ -968,6 +1178,125 @@ struct Jenkins {
         }
     }
 #undef BUFSIZE
+
+    template< int N >
+    static void batch( const char *buf, size_t length ) {
+        const void *messages[ N ];
+        std::pair< uint64, uint64 > hashes[ N ];
+        for ( int j = 0; j < N; ++j )
+            messages[ j ] = buf + j * ( length + 3 ); // varied alignment
+        SpookyHash::Hash128< N >( messages, length, 1, 2, hashes );
+        for ( int j = 0; j < N; ++j ) {
+            auto h = SpookyHash::Hash128( messages[ j ], length, 1, 2 );
+            ASSERT_EQ( h.first, hashes[ j ].first );
+            ASSERT_EQ( h.second, hashes[ j ].second );
+        }
+    }
+
+    // batches give the same results as the messages hashed one by one
+#define MAXLEN 640
+    TEST(batch)
+    {
+        char buf[ 8 * ( MAXLEN + 3 ) ];
+        Random random;
+        random.Init( 7 );
+        for ( auto &c : buf )
+            c = char( random.Value() );
+
+        for ( size_t length = 0; length < MAXLEN; ++length ) {
+            batch< 4 >( buf, length );
+            batch< 8 >( buf, length );
+        }
+
+        const void *messages[ 11 ];
+        hash128_t hashes[ 11 ];
+        for ( int j = 0; j < 11; ++j )
+            messages[ j ] = buf + 40 * j;
+        spooky( messages, 11, 12, 3, 4, hashes );
+        for ( int j = 0; j < 11; ++j )
+            ASSERT( hashes[ j ] == spooky( messages[ j ], 12, 3, 4 ) );
+    }
+#undef MAXLEN
+};
+
+}
+}
+
+#endif
+
+#ifdef BRICK_BENCHMARK_REG
+
+#include <brick-benchmark.h>
+#include <vector>
+
+namespace brick_test {
+namespace hash {
+
+using namespace ::brick::benchmark;
+
+/* bytes per second of spooky for messages of 12 bytes and 10k, one by one
+ * and in batches of 4 and 8 */
+struct Spooky : BenchmarkGroup
+{
+    Spooky() {
+        x.type = Axis::Qualitative;
+        x.name = "length";
+        x.min = 0;
+        x.max = 1;
+        x.step = 1;
+        x._render = []( int64_t i ) { return i ? "10k" : "12"; };
+
+        y.type = Axis::Qualitative;
+        y.name = "batch";
+        y.min = 0;
+        y.max = 2;
+        y.step = 1;
+        y._render = []( int64_t i ) {
+            switch ( i ) {
+                case 0: return "1";
+                case 1: return "4";
+                case 2: return "8";
+                default: ASSERT_UNREACHABLE_F( "bad i = %d", int( i ) );
+            }
+        };
+    }
+
+    std::string describe() { return "category:hash category:spooky"; }
+
+    size_t length() { return p ? 10240 : 12; }
+    size_t count() { return ( 64 << 20 ) / length(); }
+    double normal() { return 1.0 / ( count() * length() ); }
+
+    template< int N >
+    uint64 hash( const std::vector< const void * > &messages ) {
+        std::pair< uint64, uint64 > hashes[ N ];
+        uint64 sum = 0;
+        for ( size_t i = 0; i + N <= messages.size(); i += N ) {
+            SpookyHash::Hash128< N >( &messages[ i ], length(), 0, 0, hashes );
+            sum += hashes[ 0 ].first;
+        }
+        return sum;
+    }
+
+    BENCHMARK(spooky) {
+        std::vector< char > data( count() * length(), 1 );
+        std::vector< const void * > messages;
+        for ( size_t i = 0; i < count(); ++i )
+            messages.push_back( &data[ i * length() ] );
+        reset(); // do not count the setup
+
+        uint64 sum = 0;
+        switch ( q ) {
+            case 0:
+                for ( auto m : messages )
+                    sum += SpookyHash::Hash128( m, length(), 0, 0 ).first;
+                break;
+            case 1: sum = hash< 4 >( messages ); break;
+            case 2: sum = hash< 8 >( messages ); break;
+        }
+        volatile uint64 result = sum;
+        static_cast< void >( result );
+    }
 };
 
 }
@@ -34,12 +34,18 @@
 
 #include <brick-hash.h>
 #include <brick-shmem.h>
+#include <brick-mmap.h>
 #include <brick-bitlevel.h>
 #include <brick-assert.h>
 #include <brick-types.h>
 
 #include <type_traits>
 #include <set>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef BRICK_HASHSET_H
 #define BRICK_HASHSET_H
@@ -60,6 +66,7 @@ struct CellBase
 {
     using value_type = T;
     using Hasher = _Hasher;
+    static const unsigned width = 1; // slots in a cell, see GroupCell
 };
 
 template< typename T, typename Hasher >
@@ -254,6 +261,159 @@ struct AtomicCell : CellBase< T, Hasher >
     }
 };
 
+/*
+ * Control bytes of a group of slots, one per slot. A full slot has the top
+ * bit set and keeps 7 bits of the hash of its item in the rest, so that a
+ * single SSE2 compare of the whole group finds the slots which may hold an
+ * item; the items themselves are only compared on a fingerprint hit.
+ */
+struct GroupControl
+{
+    static const unsigned width = 16;
+    enum : uint8_t { Empty = 0, Busy = 1, Invalid = 2 };
+
+    /* the low bits of the hash pick the group, mix in all of them */
+    static uint8_t fingerprint( hash64_t h ) {
+        return 0x80 | uint8_t( ( h * 0x9e3779b97f4a7c15ull ) >> 57 );
+    }
+
+    /* bit i is set iff control byte i equals c */
+    unsigned match( uint8_t c ) const {
+#ifdef __SSE2__
+        return _mm_movemask_epi8( _mm_cmpeq_epi8( _bytes, _mm_set1_epi8( char( c ) ) ) );
+#else
+        unsigned m = 0;
+        for ( unsigned i = 0; i < width; ++i )
+            m |= unsigned( _bytes[ i ] == c ) << i;
+        return m;
+#endif
+    }
+
+    static unsigned lowest( unsigned mask ) { return __builtin_ctz( mask ); }
+
+    /* a snapshot of the bytes, which may be written to meanwhile */
+    explicit GroupControl( const void *bytes ) {
+#ifdef __SSE2__
+        _bytes = _mm_loadu_si128( static_cast< const __m128i * >( bytes ) );
+#else
+        std::memcpy( _bytes, bytes, width );
+#endif
+    }
+
+private:
+#ifdef __SSE2__
+    __m128i _bytes;
+#else
+    uint8_t _bytes[ width ];
+#endif
+};
+
+template< typename T >
+struct GroupSlot
+{
+    T value;
+
+    T &fetch() { return value; }
+    T copy() { return value; }
+};
+
+/*
+ * A cell of 16 slots probed together (Swiss table style). Tables of groups
+ * pick the group by the hash and probe group by group; the iterators point
+ * to the slots.
+ */
+template< typename T, typename Hasher >
+struct GroupCell : CellBase< T, Hasher >
+{
+    using Slot = GroupSlot< T >;
+    static const unsigned width = GroupControl::width;
+
+    alignas( 16 ) uint8_t _control[ width ];
+    Slot _slots[ width ];
+
+    GroupControl control() const { return GroupControl( _control ); }
+    bool full( unsigned i ) const { return _control[ i ] & 0x80; }
+
+    template< typename Value >
+    bool is( unsigned i, Value v, uint8_t fingerprint, Hasher &h ) {
+        return _control[ i ] == fingerprint && h.equal( _slots[ i ].value, v );
+    }
+
+    void store( unsigned i, T v, uint8_t fingerprint ) {
+        _slots[ i ].value = v;
+        _control[ i ] = fingerprint;
+    }
+
+    Slot &slot( unsigned i ) { return _slots[ i ]; }
+    hash64_t hash( unsigned i, Hasher &h ) { return h.hash( _slots[ i ].value ).first; }
+
+    GroupCell() : _control(), _slots() {}
+};
+
+/*
+ * The concurrent group. A slot is claimed by moving its control byte from
+ * Empty to Busy, the fingerprint is published once the item is written.
+ * Rehashing moves every control byte to Invalid.
+ */
+template< typename T, typename Hasher >
+struct GroupAtomicCell : CellBase< T, Hasher >
+{
+    using Slot = GroupSlot< T >;
+    static const unsigned width = GroupControl::width;
+
+    static_assert( sizeof( std::atomic< uint8_t > ) == 1, "control bytes must be bytes" );
+
+    alignas( 16 ) std::atomic< uint8_t > _control[ width ];
+    Slot _slots[ width ];
+
+    /* racy, a hit is confirmed by an atomic load in is() */
+    GroupControl control() const { return GroupControl( _control ); }
+    bool full( unsigned i ) const { return _control[ i ].load( std::memory_order_acquire ) & 0x80; }
+
+    template< typename Value >
+    bool is( unsigned i, Value v, uint8_t fingerprint, Hasher &h ) {
+        return _control[ i ].load( std::memory_order_acquire ) == fingerprint &&
+            h.equal( _slots[ i ].value, v );
+    }
+
+    bool tryStore( unsigned i, T v, uint8_t fingerprint ) {
+        uint8_t empty = GroupControl::Empty;
+        if ( !_control[ i ].compare_exchange_strong( empty, GroupControl::Busy ) )
+            return false;
+        _slots[ i ].value = v;
+        _control[ i ].store( fingerprint, std::memory_order_release );
+        return true;
+    }
+
+    /* returns whether the slot held an item */
+    bool invalidate( unsigned i ) {
+        uint8_t c = _control[ i ].load();
+        while ( true ) {
+            if ( c == GroupControl::Busy ) { // wait for write to end
+                c = _control[ i ].load();
+                continue;
+            }
+            if ( _control[ i ].compare_exchange_weak( c, GroupControl::Invalid ) )
+                return c & 0x80;
+        }
+    }
+
+    Slot &slot( unsigned i ) { return _slots[ i ]; }
+    hash64_t hash( unsigned i, Hasher &h ) { return h.hash( _slots[ i ].value ).first; }
+
+    GroupAtomicCell() : _slots() {
+        for ( auto &c : _control )
+            c.store( GroupControl::Empty, std::memory_order_relaxed );
+    }
+};
+
+/* what the iterators point to, the cell itself unless it is a group */
+template< typename Cell, bool = ( Cell::width > 1 ) >
+struct SlotOf { using type = Cell; };
+
+template< typename Cell >
+struct SlotOf< Cell, true > { using type = typename Cell::Slot; };
+
 // default hash implementation
 template< typename T >
 struct default_hasher {};
@@ -286,6 +446,10 @@ struct HashSetBase
 
     using value_type = typename Cell::value_type;
     using Hasher = typename Cell::Hasher;
+    using Slot = typename SlotOf< Cell >::type;
+    using Grouped = std::integral_constant< bool, ( Cell::width > 1 ) >;
+
+    static const size_t slotBytes = sizeof( Cell ) / Cell::width; // memory per unit of size()
 
     static const unsigned cacheLine = 64; // bytes
     static const unsigned thresh = cacheLine / sizeof( Cell );
@@ -296,9 +460,9 @@ struct HashSetBase
     Hasher hasher;
 
     struct iterator {
-        Cell *_cell;
+        Slot *_cell;
         bool _new;
-        iterator( Cell *c = nullptr, bool n = false ) : _cell( c ), _new( n ) {}
+        iterator( Slot *c = nullptr, bool n = false ) : _cell( c ), _new( n ) {}
         value_type *operator->() { return &(_cell->fetch()); }
         value_type &operator*() { return _cell->fetch(); }
         value_type copy() { return _cell->copy(); }
@@ -321,6 +485,15 @@ struct HashSetBase
         }
     }
 
+    /* groups are probed triangularly, which visits each of them once */
+    static size_t groupIndex( hash64_t h, size_t i, size_t mask ) {
+        return ( h + i * ( i + 1 ) / 2 ) & mask;
+    }
+
+    static size_t first( hash64_t h, size_t mask ) {
+        return Grouped::value ? groupIndex( h, 0, mask ) : index( h, 0, mask );
+    }
+
     HashSetBase( const Hasher &h ) : hasher( h ) {}
 };
 
@@ -352,7 +525,7 @@ struct _HashSet : HashSetBase< Cell >
     size_t _maxsize;
     bool _growing;
 
-    size_t size() const { return _table.size(); }
+    size_t size() const { return _table.size() * Cell::width; }
     bool empty() const { return !_used; }
 
     int count( const value_type &i ) { return find( i ).valid(); }
@@ -366,7 +539,12 @@ struct _HashSet : HashSetBase< Cell >
     }
 
     template< typename T >
-    iterator findHinted( const T &item, hash64_t hash )
+    iterator findHinted( const T &item, hash64_t hash ) {
+        return findHinted( item, hash, typename Base::Grouped() );
+    }
+
+    template< typename T >
+    iterator findHinted( const T &item, hash64_t hash, std::false_type )
     {
         size_t idx;
         for ( size_t i = 0; i < this->maxcollisions; ++i ) {
@@ -384,6 +562,25 @@ struct _HashSet : HashSetBase< Cell >
         return this->end();
     }
 
+    template< typename T >
+    iterator findHinted( const T &item, hash64_t hash, std::true_type )
+    {
+        const uint8_t fingerprint = GroupControl::fingerprint( hash );
+        for ( size_t i = 0; i < this->maxcollisions / Cell::width; ++i ) {
+            Cell &cell = _table[ this->groupIndex( hash, i, _bits ) ];
+            GroupControl control = cell.control();
+
+            for ( unsigned m = control.match( fingerprint ); m; m &= m - 1 ) {
+                unsigned slot = GroupControl::lowest( m );
+                if ( cell.is( slot, item, fingerprint, this->hasher ) )
+                    return iterator( &cell.slot( slot ) );
+            }
+            if ( control.match( GroupControl::Empty ) )
+                return this->end();
+        }
+        return this->end();
+    }
+
     iterator insertHinted( const value_type &i, hash64_t h ) {
         return insertHinted( i, h, _table, _used );
     }
@@ -392,7 +589,12 @@ struct _HashSet : HashSetBase< Cell >
     {
         if ( !_growing && size_t( _used ) > (size() / 100) * 75 )
             grow();
+        return insertHinted( item, h, table, used, typename Base::Grouped() );
+    }
 
+    iterator insertHinted( const value_type &item, hash64_t h, Table &table, int &used,
+                           std::false_type )
+    {
         size_t idx;
         for ( size_t i = 0; i < this->maxcollisions; ++i ) {
             idx = this->index( h, i, _bits );
@@ -412,6 +614,32 @@ struct _HashSet : HashSetBase< Cell >
         return insertHinted( item, h, table, used );
     }
 
+    iterator insertHinted( const value_type &item, hash64_t h, Table &table, int &used,
+                           std::true_type )
+    {
+        const uint8_t fingerprint = GroupControl::fingerprint( h );
+        for ( size_t i = 0; i < this->maxcollisions / Cell::width; ++i ) {
+            Cell &cell = table[ this->groupIndex( h, i, _bits ) ];
+            GroupControl control = cell.control();
+
+            for ( unsigned m = control.match( fingerprint ); m; m &= m - 1 ) {
+                unsigned slot = GroupControl::lowest( m );
+                if ( cell.is( slot, item, fingerprint, this->hasher ) )
+                    return iterator( &cell.slot( slot ), false );
+            }
+            if ( unsigned vacant = control.match( GroupControl::Empty ) ) {
+                unsigned slot = GroupControl::lowest( vacant );
+                ++ used;
+                cell.store( slot, item, fingerprint );
+                return iterator( &cell.slot( slot ), true );
+            }
+        }
+
+        grow();
+
+        return insertHinted( item, h, table, used );
+    }
+
     void grow() {
         if ( 2 * size() >= _maxsize )
             ASSERT_UNREACHABLE( "ran out of space in the hash table" );
@@ -425,15 +653,11 @@ struct _HashSet : HashSetBase< Cell >
 
         Table table;
 
-        table.resize( 2 * size(), Cell() );
+        table.resize( 2 * _table.size(), Cell() );
         _bits |= (_bits << 1); // unmask more
 
-        for ( auto cell : _table ) {
-            if ( cell.empty() )
-                continue;
-            insertHinted( cell.fetch(), cell.hash( this->hasher ),
-                          table, used );
-        }
+        for ( auto &cell : _table )
+            move( cell, table, used, typename Base::Grouped() );
 
         std::swap( table, _table );
         ASSERT_EQ( used, _used );
@@ -441,8 +665,21 @@ struct _HashSet : HashSetBase< Cell >
         _growing = false;
     }
 
+    void move( Cell &cell, Table &table, int &used, std::false_type ) {
+        if ( !cell.empty() )
+            insertHinted( cell.fetch(), cell.hash( this->hasher ), table, used );
+    }
+
+    void move( Cell &cell, Table &table, int &used, std::true_type ) {
+        for ( unsigned i = 0; i < Cell::width; ++i )
+            if ( cell.full( i ) )
+                insertHinted( cell.slot( i ).fetch(), cell.hash( i, this->hasher ),
+                              table, used );
+    }
+
     void setSize( size_t s )
     {
+        s = std::max( s / Cell::width, size_t( 1 ) );
         _bits = 0;
         while ((s = s >> 1))
             _bits |= s;
@@ -455,12 +692,24 @@ struct _HashSet : HashSetBase< Cell >
     }
 
     bool valid( int off ) {
+        return valid( off, typename Base::Grouped() );
+    }
+    bool valid( int off, std::false_type ) {
         return !_table[ off ].empty();
     }
+    bool valid( int off, std::true_type ) {
+        return _table[ off / Cell::width ].full( off % Cell::width );
+    }
 
     value_type &operator[]( int off ) {
+        return at( off, typename Base::Grouped() );
+    }
+    value_type &at( int off, std::false_type ) {
         return _table[ off ].fetch();
     }
+    value_type &at( int off, std::true_type ) {
+        return _table[ off / Cell::width ].slot( off % Cell::width ).fetch();
+    }
 
 
     _HashSet() : _HashSet( Hasher() ) {}
@@ -479,6 +728,9 @@ using Fast = _HashSet< FastCell< T, Hasher > >;
 template< typename T, typename Hasher = default_hasher< T > >
 using Compact = _HashSet< CompactCell< T, Hasher > >;
 
+template< typename T, typename Hasher = default_hasher< T > >
+using Group = _HashSet< GroupCell< T, Hasher > >;
+
 template< typename Cell >
 struct _ConcurrentHashSet : HashSetBase< Cell >
 {
@@ -486,6 +738,7 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
     using typename Base::Hasher;
     using typename Base::value_type;
     using typename Base::iterator;
+    using typename Base::Slot;
 
     enum class Resolution {
         Success, // the item has been inserted successfully
@@ -499,9 +752,9 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
 
     struct _Resolution {
         Resolution r;
-        Cell *c;
+        Slot *c;
 
-        _Resolution( Resolution r, Cell *c = nullptr ) : r( r ), c( c ) {}
+        _Resolution( Resolution r, Slot *c = nullptr ) : r( r ), c( c ) {}
     };
 
     using Insert = _Resolution;
@@ -514,9 +767,22 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
         ThreadData() : inserts( 0 ), currentRow( 0 ) {}
     };
 
+    /*
+     * Large rows are mapped instead of allocated by new[]. The pages come
+     * zeroed, which is an empty cell, so nobody fills the row up front; a
+     * page is faulted in by the worker which first stores into it during
+     * the cooperative rehash, which spreads the row over the NUMA nodes of
+     * the workers. The mapping asks for huge pages, as random probes of
+     * a multi-GB row miss the TLB almost every time with 4K pages.
+     */
+    static const size_t mappedRow = 2 * 1024 * 1024; // bytes
+    static constexpr bool zeroIsEmpty = std::is_trivially_destructible< Cell >::value &&
+                                        std::is_trivially_copyable< value_type >::value;
+
     struct Row {
         std::atomic< Cell * > _data;
         size_t _size;
+        bool _mapped;
 
         size_t size() const { return _size; }
 
@@ -527,16 +793,39 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
 
         bool empty() const { return begin() == nullptr; }
 
-        void resize( size_t n ) {
-            Cell *old = _data.exchange( new Cell[ n ] );
+        void resize( size_t n, bool huge = true ) {
+            bool mapped = zeroIsEmpty && n * sizeof( Cell ) >= mappedRow;
+            Cell *cells;
+            if ( mapped ) {
+                auto mode = brick::mmap::ProtectMode::Read | brick::mmap::ProtectMode::Write |
+                            brick::mmap::ProtectMode::Private;
+                if ( huge )
+                    mode = mode | brick::mmap::ProtectMode::Huge;
+                cells = static_cast< Cell * >( brick::mmap::MMap::alloc( bytes( n ), mode ) );
+            }
+            else
+                cells = new Cell[ n ];
+            release( _data.exchange( cells ), _size, _mapped );
             _size = n;
-            delete[] old;
+            _mapped = mapped;
         }
 
         void free() {
-            Cell *old = _data.exchange( nullptr );
+            release( _data.exchange( nullptr ), _size, _mapped );
             _size = 0;
-            delete[] old;
+            _mapped = false;
+        }
+
+        static size_t bytes( size_t n ) {
+            return ( n * sizeof( Cell ) + mappedRow - 1 ) / mappedRow * mappedRow;
+        }
+        static void release( Cell *cells, size_t n, bool mapped ) {
+            if ( !cells )
+                return;
+            if ( mapped )
+                brick::mmap::MMap::drop( cells, bytes( n ) );
+            else
+                delete[] cells;
         }
 
         Cell &operator[]( size_t i ) {
@@ -557,12 +846,14 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             return begin() + size();
         }
 
-        Row() : _data( nullptr ), _size( 0 ) {}
+        Row() : _data( nullptr ), _size( 0 ), _mapped( false ) {}
         ~Row() { free(); }
     };
 
     static const unsigned segmentSize = 1 << 16;// 2^16 = 65536
+    static const unsigned segmentCells = segmentSize / Cell::width;
     static const unsigned syncPoint = 1 << 10;// 2^10 = 1024
+    static const unsigned batchWindow = 16; // items prefetched ahead by insertBatch
 
     struct Data
     {
@@ -574,10 +865,11 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
         std::atomic< unsigned > doneSegments;
         std::atomic< size_t > used;
         std::atomic< bool > growing;
+        bool hugePages;
 
         Data( const Hasher &h, unsigned maxGrows )
             : hasher( h ), table( maxGrows ), tableWorkers( maxGrows ), currentRow( 0 ),
-              availableSegments( 0 ), used( 0 ), growing( false )
+              availableSegments( 0 ), used( 0 ), growing( false ), hugePages( true )
         {}
     };
 
@@ -603,7 +895,7 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
         ThreadData &_td;
         WithTD( Data &d, ThreadData &td ) : _d( d ), _td( td ) {}
 
-        size_t size() { return current().size(); }
+        size_t size() { return current().size() * Cell::width; }
         Row &current() { return _d.table[ _d.currentRow ]; }
         Row &current( unsigned index ) { return _d.table[ index ]; }
         bool changed( unsigned row ) { return row < _d.currentRow || _d.growing; }
@@ -612,6 +904,42 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             return insertHinted( x, _d.hasher.hash( x ).first );
         }
 
+        /*
+         * Inserts a whole range. Items are hashed and their first probe
+         * positions prefetched in windows of batchWindow items before any of
+         * them is inserted, so the cache misses of one window overlap.
+         * yield( item, iterator ) is called for every item in order, the
+         * iterator tells whether the item is new.
+         */
+        template< typename It, typename Yield >
+        void insertBatch( It begin, It end, Yield yield )
+        {
+            hash64_t hashes[ batchWindow ];
+            while ( begin != end ) {
+                It from = begin;
+                unsigned n = 0;
+                for ( ; begin != end && n < batchWindow; ++begin, ++n ) {
+                    hashes[ n ] = _d.hasher.hash( *begin ).first;
+                    prefetch( hashes[ n ] );
+                }
+                for ( unsigned i = 0; i < n; ++i, ++from )
+                    yield( *from, insertHinted( *from, hashes[ i ] ) );
+            }
+        }
+
+        template< typename Range, typename Yield >
+        void insertBatch( Range &range, Yield yield ) {
+            insertBatch( range.begin(), range.end(), yield );
+        }
+
+        /* only a hint, the row may be replaced meanwhile */
+        void prefetch( hash64_t h ) {
+            Row &row = current( _td.currentRow );
+            Cell *cells = row.begin();
+            if ( cells )
+                __builtin_prefetch( cells + Base::first( h, row.size() - 1 ) );
+        }
+
         template< typename T >
         iterator find( T x ) {
             return findHinted( x, _d.hasher.hash( x ).first );
@@ -678,6 +1006,12 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             if ( row.empty() )
                 return Find( Resolution::NotFound );
 
+            return findCell( v, h, rowIndex, row, typename Base::Grouped() );
+        }
+
+        template< typename T >
+        Find findCell( T v, hash64_t h, unsigned rowIndex, Row &row, std::false_type )
+        {
             const size_t mask = row.size() - 1;
 
             for ( size_t i = 0; i < Base::maxcollisions; ++i ) {
@@ -695,6 +1029,33 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             return Find( Resolution::NotFound );
         }
 
+        /* a slot which is being written to does not hold the item yet */
+        template< typename T >
+        Find findCell( T v, hash64_t h, unsigned rowIndex, Row &row, std::true_type )
+        {
+            const size_t mask = row.size() - 1;
+            const uint8_t fingerprint = GroupControl::fingerprint( h );
+
+            for ( size_t i = 0; i < Base::maxcollisions / Cell::width; ++i ) {
+                if ( changed( rowIndex ) )
+                    return Find( Resolution::Growing );
+
+                Cell &cell = row[ Base::groupIndex( h, i, mask ) ];
+                GroupControl control = cell.control();
+
+                for ( unsigned m = control.match( fingerprint ); m; m &= m - 1 ) {
+                    unsigned slot = GroupControl::lowest( m );
+                    if ( cell.is( slot, v, fingerprint, _d.hasher ) )
+                        return Find( Resolution::Found, &cell.slot( slot ) );
+                }
+                if ( control.match( GroupControl::Invalid ) )
+                    return Find( Resolution::Growing );
+                if ( control.match( GroupControl::Empty ) )
+                    return Find( Resolution::NotFound );
+            }
+            return Find( Resolution::NotFound );
+        }
+
         template< bool force >
         Insert insertCell( value_type x, hash64_t h )
         {
@@ -704,13 +1065,19 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
                 size_t u = _d.used.load( std::memory_order_relaxed );
                 // usage >= 75% of table size
                 // usage is never greater than size
-                if ( row.empty() || double( row.size() ) <= double( 4 * u ) / 3 )
+                if ( row.empty() || double( row.size() * Cell::width ) <= double( 4 * u ) / 3 )
                     return Insert( Resolution::NoSpace );
                 if ( changed( _td.currentRow ) )
                     return Insert( Resolution::Growing );
             }
 
             ASSERT( !row.empty() );
+            return insertCell< force >( x, h, row, typename Base::Grouped() );
+        }
+
+        template< bool force >
+        Insert insertCell( value_type x, hash64_t h, Row &row, std::false_type )
+        {
             const size_t mask = row.size() - 1;
 
             for ( size_t i = 0; i < Base::maxcollisions; ++i )
@@ -732,6 +1099,46 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             return Insert( Resolution::NoSpace );
         }
 
+        /*
+         * Slots of a group are claimed lowest first and never freed, so two
+         * threads inserting the same item race for the same slot; the loser
+         * waits for the write to end and finds the item there.
+         */
+        template< bool force >
+        Insert insertCell( value_type x, hash64_t h, Row &row, std::true_type )
+        {
+            const size_t mask = row.size() - 1;
+            const uint8_t fingerprint = GroupControl::fingerprint( h );
+
+            for ( size_t i = 0; i < Base::maxcollisions / Cell::width; ++i )
+            {
+                Cell &cell = row[ Base::groupIndex( h, i, mask ) ];
+
+                while ( true ) {
+                    GroupControl control = cell.control();
+
+                    for ( unsigned m = control.match( fingerprint ); m; m &= m - 1 ) {
+                        unsigned slot = GroupControl::lowest( m );
+                        if ( cell.is( slot, x, fingerprint, _d.hasher ) )
+                            return Insert( Resolution::Found, &cell.slot( slot ) );
+                    }
+                    if ( !force && ( control.match( GroupControl::Invalid ) ||
+                                     changed( _td.currentRow ) ) )
+                        return Insert( Resolution::Growing );
+                    if ( control.match( GroupControl::Busy ) )
+                        continue;
+
+                    unsigned vacant = control.match( GroupControl::Empty );
+                    if ( !vacant )
+                        break;
+                    unsigned slot = GroupControl::lowest( vacant );
+                    if ( cell.tryStore( slot, x, fingerprint ) )
+                        return Insert( Resolution::Success, &cell.slot( slot ) );
+                }
+            }
+            return Insert( Resolution::NoSpace );
+        }
+
         bool grow( unsigned rowIndex )
         {
             ASSERT( rowIndex );
@@ -751,7 +1158,7 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             }
 
             Row &row = current( rowIndex - 1 );
-            _d.table[ rowIndex ].resize( nextSize( row.size() ) );
+            _d.table[ rowIndex ].resize( nextSize( row.size() ), _d.hugePages );
             _d.currentRow.exchange( rowIndex );
             _d.tableWorkers[ rowIndex ] = 1;
             _d.doneSegments.exchange( 0 );
@@ -762,7 +1169,7 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
                 return true;
             }
 
-            const unsigned segments = std::max( row.size() / segmentSize, size_t( 1 ) );
+            const unsigned segments = std::max( row.size() / segmentCells, size_t( 1 ) );
             _d.availableSegments.exchange( segments );
 
             while ( rehashSegment() );
@@ -788,9 +1195,9 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
                 return false;
 
             Row &row = current( _d.currentRow - 1 );
-            size_t segments = std::max( row.size() / segmentSize, size_t( 1 ) );
-            auto it = row.begin() + segmentSize * segment;
-            auto end = it + segmentSize;
+            size_t segments = std::max( row.size() / segmentCells, size_t( 1 ) );
+            auto it = row.begin() + segmentCells * segment;
+            auto end = it + segmentCells;
             if ( end > row.end() )
                 end = row.end();
             ASSERT( it < end );
@@ -799,22 +1206,8 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             td.currentRow = _d.currentRow;
 
             // every cell has to be invalidated
-            for ( ; it != end; ++it ) {
-                Cell old = it->invalidate();
-                if ( old.empty() || old.invalid() )
-                    continue;
-
-                value_type value = old.fetch();
-                Resolution r = WithTD( _d, td ).insertCell< true >( value, old.hash( _d.hasher ) ).r;
-                switch( r ) {
-                    case Resolution::Success:
-                        break;
-                    case Resolution::NoSpace:
-                        ASSERT_UNREACHABLE( "ran out of space during growth" );
-                    default:
-                        ASSERT_UNREACHABLE( "internal error" );
-                }
-            }
+            for ( ; it != end; ++it )
+                rehashCell( *it, td, typename Base::Grouped() );
 
             if ( ++_d.doneSegments == segments )
                 rehashingDone();
@@ -822,6 +1215,31 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
             return segment > 0;
         }
 
+        void rehashCell( Cell &cell, ThreadData &td, std::false_type ) {
+            Cell old = cell.invalidate();
+            if ( old.empty() || old.invalid() )
+                return;
+            rehashValue( old.fetch(), old.hash( _d.hasher ), td );
+        }
+
+        void rehashCell( Cell &cell, ThreadData &td, std::true_type ) {
+            for ( unsigned i = 0; i < Cell::width; ++i )
+                if ( cell.invalidate( i ) )
+                    rehashValue( cell.slot( i ).fetch(), cell.hash( i, _d.hasher ), td );
+        }
+
+        void rehashValue( value_type value, hash64_t h, ThreadData &td ) {
+            Resolution r = WithTD( _d, td ).insertCell< true >( value, h ).r;
+            switch( r ) {
+                case Resolution::Success:
+                    break;
+                case Resolution::NoSpace:
+                    ASSERT_UNREACHABLE( "ran out of space during growth" );
+                default:
+                    ASSERT_UNREACHABLE( "internal error" );
+            }
+        }
+
         void updateIndex( unsigned &index ) {
             unsigned row = _d.currentRow;
             if ( row != index ) {
@@ -872,8 +1290,12 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
         setSize( 16 ); // by default
     }
 
+    /* large rows are mapped with huge pages unless turned off, see Row */
+    void hugePages( bool huge ) { _d.hugePages = huge; }
+
     /* XXX only usable before the first insert; rename? */
     void setSize( size_t s ) {
+        s = std::max( s / Cell::width, size_t( 1 ) );
         s = bitlevel::fill( s - 1 ) + 1;
         size_t toSet = 1;
         while ( nextSize( toSet ) < s )
@@ -892,12 +1314,24 @@ struct _ConcurrentHashSet : HashSetBase< Cell >
 
     /* multiple threads may use operator[], but not concurrently with insertions */
     value_type operator[]( size_t index ) { // XXX return a reference
+        return at( index, typename Base::Grouped() );
+    }
+    value_type at( size_t index, std::false_type ) {
         return _d.table[ _d.currentRow ][ index ].fetch();
     }
+    value_type at( size_t index, std::true_type ) {
+        return _d.table[ _d.currentRow ][ index / Cell::width ].slot( index % Cell::width ).fetch();
+    }
 
     bool valid( size_t index ) {
+        return valid( index, typename Base::Grouped() );
+    }
+    bool valid( size_t index, std::false_type ) {
         return !_d.table[ _d.currentRow ][ index ].empty();
     }
+    bool valid( size_t index, std::true_type ) {
+        return _d.table[ _d.currentRow ][ index / Cell::width ].full( index % Cell::width );
+    }
 };
 
 template< typename T, typename Hasher = default_hasher< T > >
@@ -906,6 +1340,9 @@ using FastConcurrent = _ConcurrentHashSet< FastAtomicCell< T, Hasher > >;
 template< typename T, typename Hasher = default_hasher< T > >
 using CompactConcurrent = _ConcurrentHashSet< AtomicCell< T, Hasher > >;
 
+template< typename T, typename Hasher = default_hasher< T > >
+using GroupConcurrent = _ConcurrentHashSet< GroupAtomicCell< T, Hasher > >;
+
 #ifdef BRICKS_FORCE_FAST_CONCURRENT_SET
 template< typename T, typename Hasher = default_hasher< T > >
 using Concurrent = FastConcurrent< T, Hasher >;
@@ -1089,6 +1526,35 @@ struct Parallel
             ASSERT( set.count( i ) );
     }
 
+    TEST(batch) {
+        HS< int > set;
+        typename HS< int >::ThreadData td;
+        auto withTD = set.withTD( td );
+
+        std::vector< int > items;
+        for ( int i = 1; i < 32*1024; ++i )
+            items.push_back( i % 3 ? i : 1 ); // duplicates within the batch
+        withTD.insert( 2 );
+
+        int fresh = 0, seen = 0;
+        withTD.insertBatch( items, [&]( int x, typename HS< int >::iterator it ) {
+                ASSERT_EQ( *it, x );
+                if ( it.isnew() )
+                    ++fresh;
+                else
+                    ++seen;
+            } );
+
+        int expected = 0;
+        for ( int i = 1; i < 32*1024; ++i )
+            if ( i % 3 && i != 2 )
+                ++expected;
+        ASSERT_EQ( fresh, expected );
+        ASSERT_EQ( fresh + seen, int( items.size() ) );
+        for ( int x : items )
+            ASSERT( set.count( x ) );
+    }
+
     TEST(set) {
         HS< int > set;
         set.setSize( 4 * 1024 );
@@ -1119,14 +1585,19 @@ template< typename T > using CS = Compact< T, test_hasher< T > >;
 template< typename T > using FS = Fast< T, test_hasher< T > >;
 template< typename T > using ConCS = CompactConcurrent< T, test_hasher< T > >;
 template< typename T > using ConFS = FastConcurrent< T, test_hasher< T > >;
+template< typename T > using GS = Group< T, test_hasher< T > >;
+template< typename T > using ConGS = GroupConcurrent< T, test_hasher< T > >;
 
 /* instantiate the testcases */
 template struct Sequential< CS >;
 template struct Sequential< FS >;
+template struct Sequential< GS >;
 template struct Sequential< ConCS >;
 template struct Sequential< ConFS >;
+template struct Sequential< ConGS >;
 template struct Parallel< ConCS >;
 template struct Parallel< ConFS >;
+template struct Parallel< ConGS >;
 
 }
 }
@@ -1509,19 +1980,23 @@ using B = wrap_hashset< CS >;
 using C = wrap_hashset< FS >;
 using D = wrap_hashset< ConCS >;
 using E = wrap_hashset< ConFS >;
+using H = wrap_hashset< GS >;
+using I = wrap_hashset< ConGS >;
 
 template<> struct TN< A > { static const char *n() { return "std"; } };
 template<> struct TN< B > { static const char *n() { return "scs"; } };
 template<> struct TN< C > { static const char *n() { return "sfs"; } };
 template<> struct TN< D > { static const char *n() { return "ccs"; } };
 template<> struct TN< E > { static const char *n() { return "cfs"; } };
+template<> struct TN< H > { static const char *n() { return "sgs"; } };
+template<> struct TN< I > { static const char *n() { return "cgs"; } };
 
-#define FOR_SEQ(M) M(A) M(B) M(C)
-#define SEQ A, B, C
+#define FOR_SEQ(M) M(A) M(B) M(C) M(H)
+#define SEQ A, B, C, H
 
 #ifdef BRICKS_HAVE_TBB
-#define FOR_PAR(M) M(D) M(E) M(F) M(G)
-#define PAR D, E, F, G
+#define FOR_PAR(M) M(D) M(E) M(I) M(F) M(G)
+#define PAR D, E, I, F, G
 
 template< typename T > using cus = tbb::concurrent_unordered_set< T >;
 template< typename T > using chm = tbb::concurrent_hash_map< T, empty >;
@@ -1533,8 +2008,8 @@ template<> struct TN< F > { static const char *n() { return "cus"; } };
 template<> struct TN< G > { static const char *n() { return "chm"; } };
 
 #else
-#define FOR_PAR(M) M(D) M(E)
-#define PAR D, E
+#define FOR_PAR(M) M(D) M(E) M(I)
+#define PAR D, E, I
 #endif
 
 #define TvT(N) \
@@ -1570,6 +2045,167 @@ FOR_PAR(IvR_PAR)
 #undef IvR_SEQ
 #undef IvR_PAR
 
+/* the halves have to differ, one picks the shard and the other the cell */
+struct shard_hasher {
+    hash128_t hash( int t ) const {
+        return std::make_pair( hash64_t( t ) * 0x9e3779b97f4a7c15ull, hash64_t( t ) );
+    }
+    bool valid( int t ) const { return t != 0; }
+    bool equal( int a, int b ) const { return a == b; }
+};
+
+/* each thread owns a part of the items; the others pass them over a ring */
+struct ShardThread : shmem::Thread {
+    using Ring = shmem::SpscRing< int >;
+
+    std::vector< std::unique_ptr< Ring > > *rings;
+    std::atomic< int > *inserted;
+    Fast< int, shard_hasher > set;
+    int id, threads, from, to, total;
+
+    Ring &ring( int f, int t ) { return *(*rings)[ f * threads + t ]; }
+
+    void drain() {
+        int x, n = 0;
+        for ( int f = 0; f < threads; ++f )
+            while ( ring( f, id ).pop( x ) ) {
+                set.insert( x );
+                ++n;
+            }
+        if ( n )
+            inserted->fetch_add( n );
+    }
+
+    void main() {
+        for ( int i = from; i < to; ++i ) {
+            int v = i * i + i + 41;
+            int owner = set.hasher.hash( v ).second % threads;
+            while ( !ring( id, owner ).push( v ) ) {
+                drain();
+                std::this_thread::yield();
+            }
+        }
+        while ( inserted->load() < total ) {
+            drain();
+            std::this_thread::yield();
+        }
+    }
+};
+
+template< typename HS >
+struct SharedThread : shmem::Thread {
+    HS *set;
+    typename HS::ThreadData td;
+    int from, to;
+
+    void main() {
+        auto s = set->withTD( td );
+        for ( int i = from; i < to; ++i )
+            s.insert( i * i + i + 41 );
+    }
+};
+
+struct Sharding : BenchmarkGroup
+{
+    Sharding() {
+        x = axis_threads( 8 );
+        y.type = Axis::Qualitative;
+        y.name = "type";
+        y.min = 0;
+        y.max = 1;
+        y.step = 1;
+        y._render = []( int i ) {
+            switch (i) {
+                case 0: return "shared";
+                case 1: return "sharded";
+                default: ASSERT_UNREACHABLE_F( "bad i = %d", i );
+            }
+        };
+    }
+
+    std::string describe() {
+        return "category:hashset category:sharding items:1024k";
+    }
+
+    template< typename T >
+    void run( std::vector< T > &t ) {
+        const int items = 1024 * 1024;
+        for ( int i = 0; i < p; ++i ) {
+            t[ i ].from = 1 + i * ( items / p );
+            t[ i ].to = 1 + ( i + 1 ) * ( items / p );
+        }
+        for ( auto &w : t )
+            w.start();
+        for ( auto &w : t )
+            w.join();
+    }
+
+    BENCHMARK(insert) {
+        if ( q == 0 ) {
+            ConFS< int > set;
+            std::vector< SharedThread< ConFS< int > > > t( p );
+            for ( auto &w : t )
+                w.set = &set;
+            return run( t );
+        }
+
+        std::vector< std::unique_ptr< shmem::SpscRing< int > > > rings;
+        for ( int i = 0; i < p * p; ++i )
+            rings.emplace_back( new shmem::SpscRing< int >( 1024 ) );
+        std::atomic< int > inserted( 0 );
+        std::vector< ShardThread > t( p );
+        for ( int i = 0; i < p; ++i ) {
+            t[ i ].rings = &rings;
+            t[ i ].inserted = &inserted;
+            t[ i ].id = i;
+            t[ i ].threads = p;
+            t[ i ].total = ( 1024 * 1024 / p ) * p;
+        }
+        run( t );
+    }
+};
+
+struct Rows : BenchmarkGroup
+{
+    Rows() {
+        x = axis_threads( 8 );
+        y.type = Axis::Qualitative;
+        y.name = "pages";
+        y.min = 0;
+        y.max = 1;
+        y.step = 1;
+        y._render = []( int i ) {
+            switch (i) {
+                case 0: return "4k";
+                case 1: return "huge";
+                default: ASSERT_UNREACHABLE_F( "bad i = %d", i );
+            }
+        };
+    }
+
+    std::string describe() {
+        return "category:hashset category:rows items:4096k";
+    }
+
+    // the rows grow to 128M; run under perf stat -e dTLB-load-misses to
+    // see the misses next to the times
+    BENCHMARK(insert) {
+        const int items = 4096 * 1024;
+        ConFS< int > set;
+        set.hugePages( q == 1 );
+        std::vector< SharedThread< ConFS< int > > > t( p );
+        for ( int i = 0; i < p; ++i ) {
+            t[ i ].set = &set;
+            t[ i ].from = 1 + i * ( items / p );
+            t[ i ].to = 1 + ( i + 1 ) * ( items / p );
+        }
+        for ( auto &w : t )
+            w.start();
+        for ( auto &w : t )
+            w.join();
+    }
+};
+
 
 }
 }
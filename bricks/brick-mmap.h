@@ -14,6 +14,7 @@
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <cstdint>
 
 #ifdef _WIN32
 
@@ -61,7 +62,8 @@ struct SystemException : std::exception {
 
 enum class ProtectMode {
     Read = 0x1, Write = 0x2, Execute = 0x4,
-    Shared = 0x8, Private = 0x10
+    Shared = 0x8, Private = 0x10,
+    Huge = 0x20 // alloc only: back by huge pages where the system allows
 };
 
 using ::brick::types::operator|;
@@ -102,6 +104,7 @@ struct MMap
     static void *alloc( size_t size, ProtectModeFlags flags = MALLOC_MODE ) {
         return _alloc( size, flags );
     }
+    // the same size has to be passed to drop as to alloc
     static void drop( void *ptr, size_t size ) {
         _drop( ptr, size );
     }
@@ -265,7 +268,11 @@ struct MMap
 
 #else
 
+    static const size_t hugePage = 2 * 1024 * 1024;
+
     static void *_alloc( size_t size, ProtectModeFlags flags ) {
+        if ( flags.has( ProtectMode::Huge ) )
+            return _allocHuge( size, flags );
         void *ptr = ::mmap( nullptr, size, _mmapProt( flags ), _mmapFlags( flags ) | MAP_ANONYMOUS, -1, 0 );
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wold-style-cast"
@@ -278,6 +285,37 @@ struct MMap
         ::munmap( ptr, size );
     }
 
+    // explicit huge pages come from a pool which is usually not reserved;
+    // transparent ones are used only if the mapping is aligned to them
+    static void *_allocHuge( size_t size, ProtectModeFlags flags ) {
+        int prot = _mmapProt( flags ), mf = _mmapFlags( flags ) | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+        if ( size % hugePage == 0 ) {
+            void *ptr = ::mmap( nullptr, size, prot, mf | MAP_HUGETLB, -1, 0 );
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+            if ( ptr != MAP_FAILED )
+                return ptr;
+#pragma GCC diagnostic pop
+        }
+#endif
+        void *raw = ::mmap( nullptr, size + hugePage, prot, mf, -1, 0 );
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+        if ( raw == MAP_FAILED )
+            throw SystemException( "mmap failed" );
+#pragma GCC diagnostic pop
+        char *begin = static_cast< char * >( raw );
+        size_t head = ( hugePage - reinterpret_cast< uintptr_t >( begin ) % hugePage ) % hugePage;
+        if ( head )
+            ::munmap( begin, head );
+        ::munmap( begin + head + size, hugePage - head );
+#ifdef MADV_HUGEPAGE
+        ::madvise( begin + head, size, MADV_HUGEPAGE );
+#endif
+        return begin + head;
+    }
+
     void _map( int fd ) {
         struct stat st;
         if ( fstat( fd, &st ) != 0 )
@@ -427,6 +465,23 @@ struct MMapTest {
             ASSERT_EQ( ptr[ i ], i % 256 );
         MMap::drop( ptr, 1024 );
     }
+
+#ifdef __unix
+    TEST(allocHuge) {
+        const size_t size = 4 * 1024 * 1024;
+        void *data = MMap::alloc( size, ProtectMode::Read | ProtectMode::Write |
+                                        ProtectMode::Private | ProtectMode::Huge );
+        ASSERT_EQ( reinterpret_cast< uintptr_t >( data ) % ( 2 * 1024 * 1024 ), 0u );
+        unsigned char *ptr = static_cast< unsigned char * >( data );
+        for ( size_t i = 0; i < size; i += 4096 ) {
+            ASSERT_EQ( ptr[ i ], 0 );
+            ptr[ i ] = i / 4096 % 256;
+        }
+        for ( size_t i = 0; i < size; i += 4096 )
+            ASSERT_EQ( ptr[ i ], i / 4096 % 256 );
+        MMap::drop( ptr, size );
+    }
+#endif
 };
 
 }
@@ -3,13 +3,16 @@
 #include <stdexcept>
 #include <iterator>
 #include <string>
+#include <vector>
 #include <cstring>
+#include <cstddef>
 #include <chrono>
 #include <tuple>
 #include <future>
 #include <algorithm>
 #include <type_traits>
 #include <numeric>
+#include <unordered_map>
 
 #include <unistd.h>
 #include <sys/socket.h>
@@ -18,8 +21,12 @@
 #include <sys/types.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 
 #include <brick-common.h>
 #include <brick-types.h>
@@ -109,6 +116,10 @@ struct BadMutex : NetException {
     const char *what() const noexcept override { return "bad mutex"; }
 };
 
+struct MalformedHeader : NetException {
+    const char *what() const noexcept override { return "malformed header of message"; }
+};
+
 template< typename It >
 struct Adaptor {
     Adaptor( It b, It e ) :
@@ -191,6 +202,12 @@ private:
     std::string _what;
 };
 
+// how the header of a message is laid out on the wire
+enum class WireFormat : uint8_t {
+    Fixed,  // whole header with 32-bit segment lengths, read via MSG_PEEK
+    Compact // short prefix with varint segment lengths, read via ReceiveBuffer
+};
+
 struct PollFD : pollfd {
     PollFD( int fd, int events ) {
         this->fd = fd;
@@ -211,8 +228,9 @@ class Message {
             other.clear();
         }
 
+        // segment lengths past count are never read
         void clear() {
-            std::memset( this, 0, sizeof( Header ) );
+            std::memset( this, 0, HEAD );
         }
 
         static constexpr const size_t SEGMENTS = 255;
@@ -223,6 +241,13 @@ class Message {
         static constexpr const size_t SIZE =
             HEAD + sizeof( uint32_t ) * SEGMENTS;
 
+        static constexpr const size_t VARINT = 5; // longest varint of uint32_t
+        static constexpr const size_t COMPACT_HEAD =
+            sizeof( uint8_t ) + sizeof( uint8_t ) + // category + count
+            sizeof( uint8_t ) + sizeof( uint8_t );  // from + to
+        static constexpr const size_t COMPACT_SIZE =
+            COMPACT_HEAD + VARINT + VARINT * SEGMENTS; // tag + segments
+
         size_t size() const {
             return HEAD + count * sizeof( uint32_t );
         }
@@ -245,6 +270,9 @@ class Message {
         "wrong length of C++ wrapper over iovec" );
 
 public:
+    static constexpr const size_t COMPACT_HEADER = Header::COMPACT_SIZE;
+    static constexpr const size_t SEGMENTS = Header::SEGMENTS;
+
     Message() :
         _data{ { &_header, _header.size() } }
     {}
@@ -286,6 +314,46 @@ public:
     bool full() const {
         return _header.count == Header::SEGMENTS;
     }
+
+    // compact header: category, count, from, to, zigzag varint of tag
+    // and a varint for length of each segment
+    size_t encode( char *out ) const {
+        char *begin = out;
+        *out++ = _header.category;
+        *out++ = _header.count;
+        *out++ = _header.from;
+        *out++ = _header.to;
+        int32_t tag = _header.tag;
+        out = encodeVarint( out, ( uint32_t( tag ) << 1 ) ^ uint32_t( tag >> 31 ) );
+        for ( int i = 0; i < _header.count; ++i )
+            out = encodeVarint( out, _header.segments[ i ] );
+        return out - begin;
+    }
+
+    // returns length of the compact header or zero if [begin, end) does not
+    // contain the whole header yet
+    size_t decode( const char *begin, const char *end ) {
+        const char *in = begin;
+        if ( end - in < ptrdiff_t( Header::COMPACT_HEAD ) )
+            return 0;
+        Header header;
+        header.category = *in++;
+        header.count = *in++;
+        header.from = *in++;
+        header.to = *in++;
+
+        uint32_t tag;
+        if ( !( in = decodeVarint( in, end, tag ) ) )
+            return 0;
+        header.tag = int32_t( tag >> 1 ) ^ -int32_t( tag & 1 );
+
+        for ( int i = 0; i < header.count; ++i ) {
+            if ( !( in = decodeVarint( in, end, header.segments[ i ] ) ) )
+                return 0;
+        }
+        std::memcpy( &_header, &header, header.size() );
+        return in - begin;
+    }
     Header &header() {
         return _header;
     }
@@ -341,6 +409,28 @@ protected:
 
 private:
 
+    static char *encodeVarint( char *out, uint32_t value ) {
+        while ( value >= 0x80 ) {
+            *out++ = char( value | 0x80 );
+            value >>= 7;
+        }
+        *out++ = char( value );
+        return out;
+    }
+
+    static const char *decodeVarint( const char *in, const char *end, uint32_t &value ) {
+        value = 0;
+        for ( unsigned shift = 0; in != end; shift += 7 ) {
+            if ( shift >= 7 * Header::VARINT )
+                throw MalformedHeader();
+            uint8_t byte = *in++;
+            value |= uint32_t( byte & 0x7f ) << shift;
+            if ( !( byte & 0x80 ) )
+                return in;
+        }
+        return nullptr;
+    }
+
     Header _header;
     std::vector< IOvector > _data;
 };
@@ -485,24 +575,280 @@ struct InputMessage : Message {
     }
 };
 
+// bytes read from a socket ahead of the message being processed
+struct ReceiveBuffer {
+    static constexpr const size_t CAPACITY = 64 * 1024;
+
+    ReceiveBuffer() :
+        _data( new char[ CAPACITY ] ),
+        _begin( 0 ),
+        _end( 0 )
+    {}
+
+    const char *begin() const {
+        return _data.get() + _begin;
+    }
+    const char *end() const {
+        return _data.get() + _end;
+    }
+    size_t size() const {
+        return _end - _begin;
+    }
+    bool empty() const {
+        return _begin == _end;
+    }
+
+    char *tail() {
+        return _data.get() + _end;
+    }
+    size_t room() const {
+        return CAPACITY - _end;
+    }
+
+    // make sure there is enough space for total of `length` bytes
+    void reserve( size_t length ) {
+        if ( _begin + length > CAPACITY ) {
+            std::memmove( _data.get(), begin(), size() );
+            _end -= _begin;
+            _begin = 0;
+        }
+    }
+    void produced( size_t length ) {
+        _end += length;
+    }
+    void consume( size_t length ) {
+        _begin += length;
+        if ( _begin == _end )
+            _begin = _end = 0;
+    }
+
+private:
+    std::unique_ptr< char[] > _data;
+    size_t _begin;
+    size_t _end;
+};
+
+// messages waiting to be sent together by a single send
+struct SendBuffer {
+    using Clock = std::chrono::steady_clock;
+
+    SendBuffer( size_t threshold, Clock::duration deadline ) :
+        _threshold( threshold ),
+        _deadline( deadline )
+    {
+        _data.reserve( threshold );
+    }
+
+    const char *data() const {
+        return _data.data();
+    }
+    size_t size() const {
+        return _data.size();
+    }
+    bool empty() const {
+        return _data.empty();
+    }
+    size_t threshold() const {
+        return _threshold;
+    }
+
+    void append( const IOvector *vector, size_t count ) {
+        if ( empty() )
+            _first = Clock::now();
+        for ( const IOvector &v : make_adaptor( vector, vector + count ) )
+            _data.insert( _data.end(), v.data(), v.data() + v.size() );
+    }
+    void clear() {
+        _data.clear();
+    }
+
+    bool full() const {
+        return size() >= _threshold;
+    }
+    bool expired( Clock::time_point now = Clock::now() ) const {
+        return !empty() && now - _first >= _deadline;
+    }
+
+private:
+    size_t _threshold;
+    Clock::duration _deadline;
+    Clock::time_point _first;
+    std::vector< char > _data;
+};
+
+// memory for received segments carved from reusable blocks; everything
+// given out is freed at once by release()
+struct Slab {
+    static constexpr const size_t BLOCK = 64 * 1024;
+    static constexpr const size_t ALIGN = alignof( std::max_align_t );
+
+    struct Allocator {
+        char *operator()( size_t length ) const {
+            return _slab->allocate( length );
+        }
+        Slab *_slab;
+    };
+
+    Slab() :
+        _current( 0 ),
+        _used( 0 )
+    {}
+    Slab( const Slab & ) = delete;
+    Slab &operator=( const Slab & ) = delete;
+
+    char *allocate( size_t length ) {
+        length = ( length + ALIGN - 1 ) & ~( ALIGN - 1 );
+        if ( length > BLOCK ) {
+            _large.emplace_back( new char[ length ] );
+            return _large.back().get();
+        }
+        if ( _used + length > BLOCK ) {
+            ++_current;
+            _used = 0;
+        }
+        if ( _current == _blocks.size() )
+            _blocks.emplace_back( new char[ BLOCK ] );
+        char *memory = _blocks[ _current ].get() + _used;
+        _used += length;
+        return memory;
+    }
+
+    // blocks are kept for the next messages
+    void release() {
+        _current = 0;
+        _used = 0;
+        _large.clear();
+    }
+
+    Allocator allocator() {
+        return Allocator{ this };
+    }
+
+    size_t blocks() const {
+        return _blocks.size();
+    }
+
+private:
+    std::vector< std::unique_ptr< char[] > > _blocks;
+    std::vector< std::unique_ptr< char[] > > _large;
+    size_t _current;
+    size_t _used;
+};
+
 enum class Access : bool {
     Read,
     Write
 };
 
+// counters of a socket; the threads using the socket update them without
+// locks, so they may be read at any time, even by another process if they
+// live in shared memory, see Socket::traffic( Traffic * )
+struct Traffic {
+    using Clock = std::chrono::steady_clock;
+    enum { CATEGORIES = 4, BUCKETS = 16 };
+
+    struct Snapshot {
+        uint64_t messages[ 2 ]; // indexed by Access
+        uint64_t bytes[ 2 ];
+        uint64_t blocked;       // nanoseconds spent in send calls
+        uint64_t queued;        // bytes not sent by the kernel yet, see SIOCOUTQ
+        // messages by direction, category and log2 of their size
+        uint64_t sizes[ 2 ][ CATEGORIES ][ BUCKETS ];
+    };
+
+    Traffic() {
+        for ( int d = 0; d < 2; ++d ) {
+            _messages[ d ].store( 0, std::memory_order_relaxed );
+            _bytes[ d ].store( 0, std::memory_order_relaxed );
+            for ( auto &category : _sizes[ d ] )
+                for ( auto &bucket : category )
+                    bucket.store( 0, std::memory_order_relaxed );
+        }
+        _blocked.store( 0, std::memory_order_relaxed );
+        _queued.store( 0, std::memory_order_relaxed );
+        _sampled.store( 0, std::memory_order_relaxed );
+    }
+    Traffic( const Traffic & ) = delete;
+    Traffic &operator=( const Traffic & ) = delete;
+
+    // categories are folded modulo CATEGORIES
+    void count( Access direction, uint8_t category, size_t bytes ) {
+        int d = int( direction );
+        _messages[ d ].fetch_add( 1, std::memory_order_relaxed );
+        _bytes[ d ].fetch_add( bytes, std::memory_order_relaxed );
+        _sizes[ d ][ category % CATEGORIES ][ bucket( bytes ) ].fetch_add( 1, std::memory_order_relaxed );
+    }
+    void blocked( Clock::duration time ) {
+        _blocked.fetch_add( std::chrono::duration_cast< std::chrono::nanoseconds >( time ).count(),
+                            std::memory_order_relaxed );
+    }
+    void queued( uint64_t bytes ) {
+        _queued.store( bytes, std::memory_order_relaxed );
+    }
+    // true for one caller at most once a millisecond
+    bool due( Clock::time_point now ) {
+        int64_t t = now.time_since_epoch().count();
+        int64_t last = _sampled.load( std::memory_order_relaxed );
+        if ( t - last < Clock::duration( std::chrono::milliseconds( 1 ) ).count() )
+            return false;
+        return _sampled.compare_exchange_strong( last, t, std::memory_order_relaxed );
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        for ( int d = 0; d < 2; ++d ) {
+            s.messages[ d ] = _messages[ d ].load( std::memory_order_relaxed );
+            s.bytes[ d ] = _bytes[ d ].load( std::memory_order_relaxed );
+            for ( int c = 0; c < CATEGORIES; ++c )
+                for ( int b = 0; b < BUCKETS; ++b )
+                    s.sizes[ d ][ c ][ b ] = _sizes[ d ][ c ][ b ].load( std::memory_order_relaxed );
+        }
+        s.blocked = _blocked.load( std::memory_order_relaxed );
+        s.queued = _queued.load( std::memory_order_relaxed );
+        return s;
+    }
+
+    // bucket b holds sizes from 2^b up to 2^(b+1) - 1, the last one the rest
+    static int bucket( size_t bytes ) {
+        int b = 0;
+        while ( bytes > 1 && b < BUCKETS - 1 ) {
+            bytes >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+private:
+    std::atomic< uint64_t > _messages[ 2 ];
+    std::atomic< uint64_t > _bytes[ 2 ];
+    std::atomic< uint64_t > _sizes[ 2 ][ CATEGORIES ][ BUCKETS ];
+    std::atomic< uint64_t > _blocked;
+    std::atomic< uint64_t > _queued;
+    std::atomic< int64_t > _sampled;
+};
+
 struct Socket : common::Comparable, common::Orderable {
 
     enum { Invalid = -1 };
 
     Socket() :
-        _fd{ Invalid }
+        _fd{ Invalid },
+        _format{ WireFormat::Fixed },
+        _ownTraffic{ new Traffic },
+        _traffic{ _ownTraffic.get() }
     {}
     explicit Socket( int fd ) :
-        _fd{ fd }
+        _fd{ fd },
+        _format{ WireFormat::Fixed },
+        _ownTraffic{ new Traffic },
+        _traffic{ _ownTraffic.get() }
     {}
     Socket( const Socket & ) = delete;
     Socket( Socket &&other ) :
-        _fd{ Invalid }
+        _fd{ Invalid },
+        _format{ WireFormat::Fixed },
+        _ownTraffic{ new Traffic },
+        _traffic{ _ownTraffic.get() }
     {
         swap( other );
     }
@@ -524,12 +870,67 @@ struct Socket : common::Comparable, common::Orderable {
         using std::swap;
 
         swap( _fd, other._fd );
+        swap( _format, other._format );
+        swap( _buffer, other._buffer );
+        swap( _outgoing, other._outgoing );
+        swap( _slab, other._slab );
+        swap( _ownTraffic, other._ownTraffic );
+        swap( _traffic, other._traffic );
     }
 
     int fd() const {
         return _fd;
     }
 
+    WireFormat format() const {
+        return _format;
+    }
+    // both sides have to switch at the same point of the stream
+    void format( WireFormat f ) {
+        _format = f;
+        if ( _format == WireFormat::Compact && !_buffer )
+            _buffer.reset( new ReceiveBuffer );
+    }
+
+    // there are already received bytes waiting in the buffer
+    bool pending() const {
+        return _buffer && !_buffer->empty();
+    }
+
+    // messages passed to post() are sent together once there are at least
+    // `threshold` bytes of them or the oldest one waits longer than `deadline`;
+    // zero threshold turns the coalescing off
+    void coalesce( size_t threshold, SendBuffer::Clock::duration deadline = std::chrono::milliseconds( 1 ) ) {
+        flush();
+        if ( threshold )
+            _outgoing.reset( new SendBuffer( threshold, deadline ) );
+        else
+            _outgoing.reset();
+    }
+    bool coalescing() const {
+        return bool( _outgoing );
+    }
+
+    // segments received via slab()->allocator() live until slab()->release()
+    void slab( bool attach ) {
+        if ( !attach )
+            _slab.reset();
+        else if ( !_slab )
+            _slab.reset( new Slab );
+    }
+    Slab *slab() const {
+        return _slab.get();
+    }
+
+    // counts into `external` from now on, e.g. into memory shared with
+    // another process; the socket does not own it, nullptr switches back
+    void traffic( Traffic *external ) {
+        _traffic = external ? external : _ownTraffic.get();
+    }
+    Traffic::Snapshot traffic() const {
+        return _traffic->snapshot();
+    }
+
     friend bool operator==( const Socket &lhs, const Socket &rhs ) {
         return lhs._fd == rhs._fd;
     }
@@ -549,10 +950,32 @@ struct Socket : common::Comparable, common::Orderable {
     bool closed() const {
         if ( _fd == Invalid )
             return true;
+        if ( _format == WireFormat::Compact ) {
+            if ( pending() )
+                return false;
+            ssize_t r = readAhead();
+            return r == 0 || ( r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR );
+        }
         char buf;
         return 1 != ::recv( _fd, &buf, 1, MSG_PEEK );
     }
 
+    // receive would not block - there are data or the end of stream
+    bool readable() const {
+        if ( _fd == Invalid )
+            return false;
+        if ( pending() )
+            return true;
+        ssize_t r;
+        if ( _format == WireFormat::Compact )
+            r = readAhead();
+        else {
+            char buf;
+            r = ::recv( _fd, &buf, 1, MSG_PEEK | MSG_DONTWAIT );
+        }
+        return r >= 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR );
+    }
+
     void close() {
         if ( _fd != Invalid ) {
             ::close( _fd );
@@ -572,7 +995,10 @@ struct Socket : common::Comparable, common::Orderable {
     }
 
     void peek( InputMessage &message ) const {
-        recv( &message.header(), message.header().size(), true );
+        if ( _format == WireFormat::Compact )
+            readHeader( message );
+        else
+            recv( &message.header(), message.header().size(), true );
     }
 
     void receive( InputMessage &message ) const {
@@ -580,14 +1006,64 @@ struct Socket : common::Comparable, common::Orderable {
     }
 
     void receiveHeader( InputMessage &message ) const {
+        if ( _slab ) {
+            receive( message, _slab->allocator() );
+            return;
+        }
         receive( message );
         message.cleanup< char >( []( char *d ) {
             delete[] d;
         } );
     }
 
+    // receives a message made of segments of T directly into `out`,
+    // returns the number of items received
+    template< typename T >
+    size_t receiveInto( InputMessage &message, T *out, size_t capacity ) const {
+        static_assert( std::is_trivially_copyable< T >::value, "T has to be trivially copyable" );
+
+        // the header is only peeked at until the size is known to fit, a
+        // message which does not fit stays whole in the socket
+        size_t header;
+        if ( _format == WireFormat::Compact )
+            header = readHeader( message );
+        else {
+            recv( &message.header(), message.header().head(), true );
+            // the size depends on the count in the head
+            header = message.header().size();
+            recv( &message.header(), header, true );
+        }
+
+        size_t length = std::accumulate(
+            message.header().segments,
+            message.header().segments + message.count(),
+            size_t( 0 ) );
+        if ( length % sizeof( T ) || length > capacity * sizeof( T ) )
+            throw DataTransferException( "receive", capacity * sizeof( T ), length );
+
+        if ( _format == WireFormat::Compact )
+            _buffer->consume( header );
+        else
+            recv( &message.header(), message.header().size() );
+
+        if ( _format == WireFormat::Compact )
+            receiveSegment( reinterpret_cast< char * >( out ), length );
+        else if ( length ) {
+            size_t received = recv( out, length );
+            if ( received != length )
+                throw DataTransferException( "receive", length, received );
+        }
+        _traffic->count( Access::Read, message.category< uint8_t >(), header + length );
+        return length / sizeof( T );
+    }
+
     template< typename A >
     void receive( InputMessage &message, A allocator ) const {
+        if ( _format == WireFormat::Compact ) {
+            receiveCompact( message, allocator );
+            return;
+        }
+
         struct msghdr header;
         std::memset( &header, 0, sizeof( header ) );
 
@@ -609,25 +1085,90 @@ struct Socket : common::Comparable, common::Orderable {
                     message.header().size() + received
                 );
         }
+        _traffic->count( Access::Read, message.category< uint8_t >(), message.bytes() );
     }
 
     void send( OutputMessage &message, bool noThrow = false ) const {
         struct msghdr header;
         std::memset( &header, 0, sizeof( header ) );
 
+        // keep the order of messages
+        flush( noThrow );
+
         header.msg_iov = message.vector();
         header.msg_iovlen = message.count() + 1;
+        size_t expected = message.bytes();
+
+        // sendAll passes one message to several threads, so the compact
+        // header goes to a private copy of the vector
+        char compact[ Message::COMPACT_HEADER ];
+        IOvector vector[ Message::SEGMENTS + 1 ];
+        if ( _format == WireFormat::Compact ) {
+            std::copy( message.vector(), message.vector() + message.count() + 1, vector );
+            expected -= vector[ 0 ].size();
+            vector[ 0 ] = IOvector( compact, message.encode( compact ) );
+            expected += vector[ 0 ].size();
+            header.msg_iov = vector;
+        }
 
+        auto start = Traffic::Clock::now();
         size_t sent = sendmsg( header, noThrow );
+        timed( start );
+        if ( ssize_t( sent ) > 0 )
+            _traffic->count( Access::Write, message.category< uint8_t >(), sent );
 
-        if ( !noThrow && message.bytes() != sent )
+        if ( !noThrow && expected != sent )
             throw DataTransferException(
                 "send",
-                message.bytes(),
+                expected,
                 sent
             );
     }
 
+    // same as send if the socket is not coalescing
+    void post( OutputMessage &message ) const {
+        if ( !_outgoing || message.bytes() >= _outgoing->threshold() ) {
+            send( message );
+            return;
+        }
+
+        char compact[ Message::COMPACT_HEADER ];
+        IOvector header = message.vector()[ 0 ];
+        if ( _format == WireFormat::Compact )
+            header = IOvector( compact, message.encode( compact ) );
+
+        _outgoing->append( &header, 1 );
+        _outgoing->append( message.vector() + 1, message.count() );
+        _traffic->count( Access::Write, message.category< uint8_t >(),
+                         header.size() + message.bytes() - message.vector()[ 0 ].size() );
+
+        if ( _outgoing->full() || _outgoing->expired() )
+            flush();
+    }
+
+    void flush( bool noThrow = false ) const {
+        if ( !_outgoing || _outgoing->empty() )
+            return;
+
+        auto start = Traffic::Clock::now();
+        ssize_t sent = ::send( _fd, _outgoing->data(), _outgoing->size(), MSG_NOSIGNAL );
+        timed( start );
+        size_t expected = _outgoing->size();
+        _outgoing->clear();
+        if ( noThrow )
+            return;
+        if ( sent < 0 )
+            errnoHandler( "send" );
+        if ( size_t( sent ) != expected )
+            throw DataTransferException( "flush", expected, sent );
+    }
+
+    // flush only if the oldest waiting message is too old
+    void flushExpired( SendBuffer::Clock::time_point now = SendBuffer::Clock::now() ) const {
+        if ( _outgoing && _outgoing->expired( now ) )
+            flush();
+    }
+
     ssize_t peek( void *buffer, size_t length ) const {
         ssize_t r = ::recv( _fd, buffer, length, MSG_PEEK | MSG_WAITALL );
         if ( r >= 0 )
@@ -673,8 +1214,95 @@ struct Socket : common::Comparable, common::Orderable {
             throw SystemException( "setsockopt" );
     }
 
+    // sends small messages immediately instead of waiting for acknowledgements
+    void setNoDelay( bool noDelay = true ) {
+        int on = noDelay;
+        if ( ::setsockopt( _fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) ) == -1 )
+            throw SystemException( "setsockopt" );
+    }
+
 private:
 
+    // adds the time of a send; the queue of the kernel is sampled at most
+    // once a millisecond as the ioctl is not for free
+    void timed( Traffic::Clock::time_point start ) const {
+        auto now = Traffic::Clock::now();
+        _traffic->blocked( now - start );
+        if ( _traffic->due( now ) ) {
+            int queued = 0;
+            if ( ::ioctl( _fd, SIOCOUTQ, &queued ) == 0 )
+                _traffic->queued( queued );
+        }
+    }
+
+    // read instead of peeking - the data are going to be used
+    ssize_t readAhead() const {
+        ssize_t r = ::recv( _fd, _buffer->tail(), _buffer->room(), MSG_DONTWAIT );
+        if ( r > 0 )
+            _buffer->produced( r );
+        return r;
+    }
+
+    // make sure there are at least `length` bytes in the buffer
+    void fill( size_t length ) const {
+        _buffer->reserve( length );
+        while ( _buffer->size() < length ) {
+            ssize_t r = ::recv( _fd, _buffer->tail(), _buffer->room(), 0 );
+            if ( r == 0 )
+                throw ConnectionAbortedException( "receive" );
+            if ( r < 0 ) {
+                if ( errno == EINTR )
+                    continue;
+                errnoHandler( "recv" );
+            }
+            _buffer->produced( r );
+        }
+    }
+
+    // decodes header without consuming it from the buffer
+    size_t readHeader( InputMessage &message ) const {
+        size_t length;
+        while ( !( length = message.decode( _buffer->begin(), _buffer->end() ) ) )
+            fill( _buffer->size() + 1 );
+        return length;
+    }
+
+    template< typename A >
+    void receiveCompact( InputMessage &message, A allocator ) const {
+        size_t header = readHeader( message );
+        _buffer->consume( header );
+
+        if ( message.count() ) {
+            message.allocateData( allocator );
+
+            for ( IOvector &v : make_adaptor( message.vector() + 1, message.vector() + message.count() + 1 ) )
+                receiveSegment( v.data(), v.size() );
+        }
+        _traffic->count( Access::Read, message.category< uint8_t >(),
+                         header + message.bytes() - message.header().size() );
+    }
+
+    void receiveSegment( char *out, size_t left ) const {
+        // large segments bypass the buffer
+        if ( left >= ReceiveBuffer::CAPACITY / 2 ) {
+            size_t buffered = std::min( left, _buffer->size() );
+            std::copy( _buffer->begin(), _buffer->begin() + buffered, out );
+            _buffer->consume( buffered );
+            out += buffered;
+            left -= buffered;
+            if ( left ) {
+                size_t received = recv( out, left );
+                if ( received != left )
+                    throw DataTransferException( "receive", left, received );
+            }
+            return;
+        }
+
+        fill( left );
+        std::copy( _buffer->begin(), _buffer->begin() + left, out );
+        _buffer->consume( left );
+    }
+
     size_t recvmsg( struct msghdr &message ) const {
         ssize_t r = ::recvmsg( _fd, &message, MSG_WAITALL );
         if ( r >= 0 )
@@ -732,12 +1360,147 @@ private:
     }
 
     int _fd;
+    WireFormat _format;
+    std::unique_ptr< ReceiveBuffer > _buffer;
+    std::unique_ptr< SendBuffer > _outgoing;
+    std::unique_ptr< Slab > _slab;
+    std::unique_ptr< Traffic > _ownTraffic;
+    Traffic *_traffic;
 };
 
 inline void swap( Socket &lhs, Socket &rhs ) {
     lhs.swap( rhs );
 }
 
+enum class Polling {
+    Poll,  // set of sockets is passed to each call
+    Epoll  // sockets are registered in an EventSet
+};
+
+// persistent set of sockets watched by edge-triggered epoll
+template< typename S > // SocketPtr
+struct EventSet {
+
+    // what process() tells about the socket it got
+    enum class Result {
+        Drained, // nothing more to read
+        Ready,   // there are more data
+        Stop     // do not process other sockets
+    };
+
+    EventSet() :
+        _fd( ::epoll_create1( EPOLL_CLOEXEC ) )
+    {
+        if ( _fd == -1 )
+            throw SystemException( "epoll_create1" );
+    }
+    EventSet( const EventSet & ) = delete;
+    EventSet &operator=( const EventSet & ) = delete;
+    ~EventSet() {
+        ::close( _fd );
+    }
+
+    void add( S socket ) {
+        struct epoll_event event;
+        std::memset( &event, 0, sizeof( event ) );
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        int fd = event.data.fd = socket->fd();
+
+        if ( ::epoll_ctl( _fd, EPOLL_CTL_ADD, fd, &event ) == -1 )
+            throw SystemException( "epoll_ctl" );
+
+        // buffered data do not make an edge
+        bool pending = socket->pending();
+        _sockets[ fd ] = Entry{ std::move( socket ), pending };
+        if ( pending )
+            _ready.push_back( fd );
+    }
+
+    // the socket may be closed already, so it is not looked up by fd
+    void remove( const S &socket ) {
+        auto i = std::find_if( _sockets.begin(), _sockets.end(), [&]( const std::pair< const int, Entry > &e ) {
+            return e.second.socket == socket;
+        } );
+        if ( i == _sockets.end() )
+            return;
+        int fd = i->first;
+        ::epoll_ctl( _fd, EPOLL_CTL_DEL, fd, nullptr );
+        _ready.erase( std::remove( _ready.begin(), _ready.end(), fd ), _ready.end() );
+        _sockets.erase( i );
+    }
+
+    size_t size() const {
+        return _sockets.size();
+    }
+
+    // process gets each ready socket once and returns Result
+    template< typename P >
+    int wait( P process, int timeout ) {
+        // sockets which were not drained will not get another edge
+        if ( !_ready.empty() )
+            timeout = 0;
+
+        struct epoll_event events[ 64 ];
+        int r;
+        do {
+            r = ::epoll_wait( _fd, events, 64, timeout );
+        } while ( r == -1 && errno == EINTR );
+
+        if ( r == -1 )
+            throw SystemException( "epoll_wait" );
+
+        for ( int i = 0; i < r; ++i ) {
+            auto s = _sockets.find( events[ i ].data.fd );
+            if ( s == _sockets.end() || s->second.ready )
+                continue;
+            s->second.ready = true;
+            _ready.push_back( s->first );
+        }
+
+        // process may add or remove sockets
+        std::vector< int > ready;
+        ready.swap( _ready );
+
+        int processed = 0;
+        size_t i = 0;
+        while ( i < ready.size() ) {
+            int fd = ready[ i++ ];
+            auto e = _sockets.find( fd );
+            if ( e == _sockets.end() || !e->second.ready )
+                continue;
+            S socket = e->second.socket;
+            Result result = process( socket );
+            ++processed;
+
+            e = _sockets.find( fd );
+            if ( e == _sockets.end() || e->second.socket != socket )
+                continue;
+            if ( result == Result::Drained )
+                e->second.ready = false;
+            else
+                _ready.push_back( fd );
+            if ( result == Result::Stop )
+                break;
+        }
+        for ( ; i < ready.size(); ++i ) {
+            auto e = _sockets.find( ready[ i ] );
+            if ( e != _sockets.end() && e->second.ready )
+                _ready.push_back( ready[ i ] );
+        }
+        return processed;
+    }
+
+private:
+    struct Entry {
+        S socket;
+        bool ready;
+    };
+
+    int _fd;
+    std::unordered_map< int, Entry > _sockets;
+    std::vector< int > _ready;
+};
+
 struct Network {
     Network( const char *port, bool autobind = true ) :
         _port( port )
@@ -760,16 +1523,21 @@ struct Network {
         if ( listen && _ear )
             fds.emplace_back( _ear.fd(), POLLIN );
 
-        for ( const auto &s : toWait )
+        // buffered data do not wake poll up
+        bool pending = false;
+        for ( const auto &s : toWait ) {
             fds.emplace_back( s->fd(), POLLIN );
-
+            pending = pending || s->pending();
+        }
+        if ( pending )
+            timeout = 0;
 
         int r;
         do {
             r = ::poll( static_cast< pollfd * >( &fds.front() ), fds.size(), timeout );
         } while ( r == -1 && errno == EINTR );
 
-        if ( r == 0 || ( r == -1 && errno == EAGAIN ) )
+        if ( ( r == 0 && !pending ) || ( r == -1 && errno == EAGAIN ) )
             return 0;
 
         if ( r == -1 )
@@ -786,7 +1554,7 @@ struct Network {
             ++selected;
 
         for ( const auto &s : toWait ) {
-            if ( selected->revents ) {
+            if ( selected->revents || s->pending() ) {
                 if ( !process( s ) )
                     break;
             }
@@ -953,7 +1721,8 @@ private:
 
         if ( !rp )
             throw SystemException( "bind" );
-        if ( ::listen( _ear.fd(), 25 ) )
+        // peers open all their lines at once while forming a world
+        if ( ::listen( _ear.fd(), SOMAXCONN ) )
             throw SystemException( "listen" );
     }
 
@@ -1278,6 +2047,282 @@ struct Message {
         receive( in, 0, 10, 6 );
     }
 
+    TEST( compact ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( WireFormat::Compact );
+        out.format( WireFormat::Compact );
+
+        OutputMessage o( 3 );
+        o.tag( -12 );
+        o.from( 1 );
+        o.to( 2 );
+        std::string outBuffer = "karel";
+        int outData = 1258;
+        o << outBuffer << outData;
+        out.send( o );
+
+        std::string inBuffer;
+        int inData = 0;
+        InputMessage i;
+        i >> inBuffer >> inData;
+        in.receive( i );
+
+        ASSERT_EQ( 3, i.category() );
+        ASSERT_EQ( -12, i.tag() );
+        ASSERT_EQ( 1, i.from() );
+        ASSERT_EQ( 2, i.to() );
+        ASSERT_EQ( outBuffer, inBuffer );
+        ASSERT_EQ( outData, inData );
+        ASSERT( !in.pending() );
+    }
+
+    TEST( traffic ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( WireFormat::Compact );
+        out.format( WireFormat::Compact );
+
+        OutputMessage o( 1 );
+        o.tag( 10 );
+        int data = 6;
+        o << data;
+        out.send( o );
+        out.send( o );
+
+        int incoming;
+        InputMessage i;
+        i >> incoming;
+        in.receive( i );
+
+        // category, count, from, to, tag, one segment length, payload
+        size_t bytes = 4 + 1 + 1 + 4;
+        Traffic::Snapshot sent = out.traffic(), received = in.traffic();
+        ASSERT_EQ( 2u, sent.messages[ int( Access::Write ) ] );
+        ASSERT_EQ( 2 * bytes, sent.bytes[ int( Access::Write ) ] );
+        ASSERT_EQ( 2u, sent.sizes[ int( Access::Write ) ][ 1 ][ Traffic::bucket( bytes ) ] );
+        ASSERT_EQ( 1u, received.messages[ int( Access::Read ) ] );
+        ASSERT_EQ( bytes, received.bytes[ int( Access::Read ) ] );
+        ASSERT_EQ( 0u, received.messages[ int( Access::Write ) ] );
+
+        Traffic shared;
+        out.traffic( &shared );
+        out.send( o );
+        ASSERT_EQ( 1u, shared.snapshot().messages[ int( Access::Write ) ] );
+        ASSERT_EQ( 1u, out.traffic().messages[ int( Access::Write ) ] );
+        out.traffic( nullptr );
+        ASSERT_EQ( 2u, out.traffic().messages[ int( Access::Write ) ] );
+    }
+
+    TEST( compactSize ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        out.format( WireFormat::Compact );
+
+        OutputMessage o( 0 );
+        o.tag( 10 );
+        int data = 6;
+        o << data;
+        out.send( o );
+
+        char buffer[ 64 ];
+        // category, count, from, to, tag, one segment length, payload
+        ASSERT_EQ( 4 + 1 + 1 + 4, ::recv( in.fd(), buffer, 64, MSG_DONTWAIT ) );
+    }
+
+    TEST( compactBuffered ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( WireFormat::Compact );
+        out.format( WireFormat::Compact );
+
+        for ( int t = 0; t < 100; ++t ) {
+            OutputMessage o( 0 );
+            o.tag( t );
+            o << t;
+            out.send( o );
+        }
+
+        ASSERT( !in.closed() );
+        ASSERT( in.pending() );
+        for ( int t = 0; t < 100; ++t ) {
+            InputMessage peeked;
+            in.peek( peeked );
+            ASSERT_EQ( t, peeked.tag() );
+
+            int data = -1;
+            InputMessage i;
+            i >> data;
+            in.receive( i );
+            ASSERT_EQ( t, i.tag() );
+            ASSERT_EQ( t, data );
+        }
+        ASSERT( !in.pending() );
+    }
+
+    TEST( compactLarge ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( WireFormat::Compact );
+        out.format( WireFormat::Compact );
+
+        std::vector< char > outBuffer( 3 * ReceiveBuffer::CAPACITY );
+        for ( size_t i = 0; i < outBuffer.size(); ++i )
+            outBuffer[ i ] = char( i * 7 );
+        std::vector< char > inBuffer( outBuffer.size() );
+
+        auto sender = std::async( std::launch::async, [&] {
+            OutputMessage o( 0 );
+            o << outBuffer;
+            out.send( o );
+            out.send( o );
+        } );
+
+        for ( int r = 0; r < 2; ++r ) {
+            InputMessage i;
+            i.add( inBuffer.data(), inBuffer.size() );
+            in.receive( i );
+            ASSERT( outBuffer == inBuffer );
+            std::fill( inBuffer.begin(), inBuffer.end(), 0 );
+        }
+        sender.get();
+    }
+
+    TEST( receiveInto ) {
+        for ( WireFormat format : { WireFormat::Fixed, WireFormat::Compact } ) {
+            Socket in, out;
+            std::tie( in, out ) = Network::socketPair();
+            in.format( format );
+            out.format( format );
+
+            std::vector< int > outBuffer = { 1, 2, 3, 4, 5 };
+            int tail = 6;
+            OutputMessage o( 0 );
+            o.tag( 7 );
+            o << outBuffer << tail;
+            out.send( o );
+            out.send( o );
+
+            int inBuffer[ 8 ] = {};
+            InputMessage i;
+            ASSERT_EQ( 6u, in.receiveInto( i, inBuffer, 8 ) );
+            ASSERT_EQ( 7, i.tag() );
+            ASSERT_EQ( out.traffic().bytes[ int( Access::Write ) ],
+                       2 * in.traffic().bytes[ int( Access::Read ) ] );
+            for ( int k = 0; k < 6; ++k )
+                ASSERT_EQ( k + 1, inBuffer[ k ] );
+
+            // does not fit
+            InputMessage j;
+            bool thrown = false;
+            try {
+                in.receiveInto( j, inBuffer, 4 );
+            } catch ( DataTransferException & ) {
+                thrown = true;
+            }
+            ASSERT( thrown );
+
+            // and is left whole in the socket
+            std::fill( inBuffer, inBuffer + 8, 0 );
+            InputMessage k;
+            ASSERT_EQ( 6u, in.receiveInto( k, inBuffer, 8 ) );
+            ASSERT_EQ( 6, inBuffer[ 5 ] );
+        }
+    }
+
+    TEST( slab ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.slab( true );
+
+        std::string outBuffer = "karel";
+        for ( int r = 0; r < 100; ++r ) {
+            OutputMessage o( 0 );
+            o << outBuffer << outBuffer;
+            out.send( o );
+
+            InputMessage i;
+            in.receive( i, in.slab()->allocator() );
+            i.process( [&]( char *data, size_t length ) {
+                ASSERT_EQ( outBuffer, std::string( data, length ) );
+            } );
+            in.slab()->release();
+        }
+        ASSERT_EQ( 1u, in.slab()->blocks() );
+
+        Slab slab;
+        char *first = slab.allocate( 1 );
+        char *second = slab.allocate( Slab::BLOCK );
+        ASSERT( first != second );
+        ASSERT_EQ( 2u, slab.blocks() );
+        slab.release();
+        ASSERT( first == slab.allocate( 10 ) );
+        ASSERT_EQ( 0u, reinterpret_cast< uintptr_t >( slab.allocate( 3 ) ) % Slab::ALIGN );
+        ASSERT( slab.allocate( 2 * Slab::BLOCK ) );
+        ASSERT_EQ( 2u, slab.blocks() );
+    }
+
+    TEST( coalesced ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( WireFormat::Compact );
+        out.format( WireFormat::Compact );
+        out.coalesce( 1024, std::chrono::hours( 1 ) );
+
+        for ( int t = 0; t < 3; ++t ) {
+            OutputMessage o( 0 );
+            o.tag( t );
+            o << t;
+            out.post( o );
+        }
+        char buffer;
+        ASSERT_EQ( -1, ::recv( in.fd(), &buffer, 1, MSG_DONTWAIT | MSG_PEEK ) );
+
+        out.flush();
+        for ( int t = 0; t < 3; ++t ) {
+            int data = -1;
+            InputMessage i;
+            i >> data;
+            in.receive( i );
+            ASSERT_EQ( t, i.tag() );
+            ASSERT_EQ( t, data );
+        }
+        ASSERT( !in.pending() );
+    }
+
+    TEST( coalescedThreshold ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        out.coalesce( 64, std::chrono::hours( 1 ) );
+
+        int data = 6;
+        int sent = 0;
+        char buffer;
+        while ( ::recv( in.fd(), &buffer, 1, MSG_DONTWAIT | MSG_PEEK ) == -1 ) {
+            OutputMessage o( 0 );
+            o << data;
+            out.post( o );
+            ++sent;
+        }
+        // fixed header of 8 bytes, one segment length and the payload
+        ASSERT_EQ( ( 64 + 15 ) / 16, sent );
+
+        // an immediate send must not overtake the gathered message
+        OutputMessage o( 0 );
+        o.tag( 1 );
+        out.post( o );
+        o.tag( 2 );
+        out.send( o );
+        for ( int i = 0; i < sent; ++i )
+            receive( in, 0, 0, data );
+
+        InputMessage m;
+        in.receiveHeader( m );
+        ASSERT_EQ( 1, m.tag() );
+        in.receiveHeader( m );
+        ASSERT_EQ( 2, m.tag() );
+    }
+
     TEST( redirector ) {
         ::alarm( 10 );
         int p[2];
@@ -1297,7 +2342,211 @@ struct Message {
     }
 };
 
+struct Events {
+    using Channel = std::shared_ptr< Socket >;
+    using Result = EventSet< Channel >::Result;
+
+    static std::pair< Channel, Channel > pair( WireFormat format = WireFormat::Fixed ) {
+        Socket in, out;
+        std::tie( in, out ) = Network::socketPair();
+        in.format( format );
+        out.format( format );
+        return { std::make_shared< Socket >( std::move( in ) ),
+                 std::make_shared< Socket >( std::move( out ) ) };
+    }
+
+    static void send( Channel &channel, int data ) {
+        OutputMessage o( 0 );
+        o << data;
+        channel->send( o );
+    }
+
+    static int take( Channel &channel ) {
+        int data = -1;
+        InputMessage i;
+        i >> data;
+        channel->receive( i );
+        return data;
+    }
+
+    TEST( ready ) {
+        EventSet< Channel > events;
+        std::vector< std::pair< Channel, Channel > > pairs;
+        for ( int i = 0; i < 4; ++i ) {
+            pairs.push_back( pair() );
+            events.add( pairs.back().first );
+        }
+        ASSERT_EQ( 0, events.wait( []( const Channel & ) { return Result::Drained; }, 0 ) );
+
+        send( pairs[ 2 ].second, 2 );
+        int got = -1;
+        ASSERT_EQ( 1, events.wait( [&]( Channel channel ) {
+            got = take( channel );
+            return Result::Drained;
+        }, -1 ) );
+        ASSERT_EQ( 2, got );
+        ASSERT_EQ( 0, events.wait( []( const Channel & ) { return Result::Drained; }, 0 ) );
+    }
+
+    TEST( edge ) {
+        EventSet< Channel > events;
+        auto p = pair();
+        events.add( p.first );
+
+        send( p.second, 1 );
+        send( p.second, 2 );
+        ASSERT_EQ( 1, events.wait( [&]( Channel channel ) {
+            ASSERT_EQ( 1, take( channel ) );
+            return channel->readable() ? Result::Ready : Result::Drained;
+        }, -1 ) );
+        // no new edge, but the socket was not drained
+        ASSERT_EQ( 1, events.wait( [&]( Channel channel ) {
+            ASSERT_EQ( 2, take( channel ) );
+            return channel->readable() ? Result::Ready : Result::Drained;
+        }, -1 ) );
+        ASSERT( !p.first->readable() );
+    }
+
+    TEST( pending ) {
+        auto p = pair( WireFormat::Compact );
+        send( p.second, 1 );
+        send( p.second, 2 );
+        ASSERT_EQ( 1, take( p.first ) );
+        // the rest is in the receive buffer and will not make an edge
+        ASSERT( p.first->pending() );
+
+        EventSet< Channel > events;
+        events.add( p.first );
+        ASSERT_EQ( 1, events.wait( [&]( Channel channel ) {
+            ASSERT_EQ( 2, take( channel ) );
+            return Result::Drained;
+        }, -1 ) );
+    }
+
+    TEST( stop ) {
+        EventSet< Channel > events;
+        auto a = pair(), b = pair();
+        events.add( a.first );
+        events.add( b.first );
+        send( a.second, 1 );
+        send( b.second, 2 );
+
+        int taken = 0;
+        // the stopping socket is kept ready as well
+        auto once = [&]( Channel channel ) {
+            if ( !channel->readable() )
+                return Result::Drained;
+            take( channel );
+            ++taken;
+            return Result::Stop;
+        };
+        ASSERT_EQ( 1, events.wait( once, -1 ) );
+        ASSERT_EQ( 1, taken );
+        events.wait( once, 0 );
+        ASSERT_EQ( 2, taken );
+    }
+
+    TEST( remove ) {
+        EventSet< Channel > events;
+        auto a = pair(), b = pair();
+        events.add( a.first );
+        events.add( b.first );
+        send( a.second, 1 );
+        send( b.second, 2 );
+
+        int processed = events.wait( [&]( Channel channel ) {
+            // the other one is gone
+            events.remove( channel == a.first ? b.first : a.first );
+            take( channel );
+            return Result::Drained;
+        }, -1 );
+        ASSERT_EQ( 1, processed );
+        ASSERT_EQ( 1u, events.size() );
+    }
+};
+
 } // namespace net
 } // namespace brick_test
 
+#ifdef BRICK_BENCHMARK_REG
+
+#include <brick-benchmark.h>
+
+namespace brick_test {
+namespace net {
+
+using namespace ::brick::benchmark;
+
+// one of many sockets is ready, as in a dedicated worker of a big world
+struct Polling : BenchmarkGroup
+{
+    Polling() {
+        x.type = Axis::Quantitative;
+        x.name = "sockets";
+        x.min = 4;
+        x.max = 256;
+        x.log = true;
+        x.step = 2;
+
+        y.type = Axis::Qualitative;
+        y.name = "type";
+        y.min = 0;
+        y.max = 1;
+        y.step = 1;
+        y._render = []( int i ) {
+            switch ( i ) {
+                case 0: return "poll";
+                case 1: return "epoll";
+                default: ASSERT_UNREACHABLE_F( "bad i = %d", i );
+            }
+        };
+    }
+
+    std::string describe() {
+        return "category:net category:polling";
+    }
+
+    using Channel = std::shared_ptr< Socket >;
+    using Result = EventSet< Channel >::Result;
+    static const int rounds = 10000;
+
+    BENCHMARK(one_ready) {
+        std::vector< Channel > in, out;
+        for ( int i = 0; i < p; ++i ) {
+            Socket a, b;
+            std::tie( a, b ) = Network::socketPair();
+            in.push_back( std::make_shared< Socket >( std::move( a ) ) );
+            out.push_back( std::make_shared< Socket >( std::move( b ) ) );
+        }
+        Network network( "0", false );
+        EventSet< Channel > events;
+        for ( const auto &s : in )
+            events.add( s );
+
+        OutputMessage o( 0 );
+        InputMessage i;
+        auto take = [&]( const Channel &channel ) {
+            channel->receiveHeader( i );
+            return true;
+        };
+        reset(); // do not count the setup
+
+        for ( int r = 0; r < rounds; ++r ) {
+            out[ r % p ]->send( o );
+            if ( q == 0 )
+                network.poll( in, []( Socket ) {}, take, -1, false );
+            else
+                events.wait( [&]( const Channel &channel ) {
+                    take( channel );
+                    return Result::Drained;
+                }, -1 );
+        }
+    }
+};
+
+} // namespace net
+} // namespace brick_test
+
+#endif
+
 #endif
@@ -3,6 +3,7 @@
 /*
  * Utilities and data structures for shared-memory parallelism. Includes:
  * - shared memory, lock-free first-in/first-out queue (one reader + one writer)
+ * - lock-free work-stealing deque (one owner + many thieves)
  * - a spinlock
  * - approximate counter (share a counter between threads without contention)
  * - a weakened atomic type (like std::atomic)
@@ -39,15 +40,19 @@
 
 #include <brick-assert.h>
 #include <deque>
+#include <vector>
+#include <memory>
 #include <iostream>
 #include <typeinfo>
 
 #if __cplusplus >= 201103L
 #include <mutex>
 #include <atomic>
+#include <cstdint>
 #include <thread>
 #include <stdexcept>
 #include <mutex>
+#include <condition_variable>
 #endif
 
 #ifndef BRICK_SHMEM_H
@@ -532,13 +537,367 @@ struct LockedQueue {
     LockedQueue &operator=( const LockedQueue & ) = delete;
 };
 
+/*
+ * A work-stealing deque after Chase and Lev (with the memory orderings given
+ * by Lê et al., "Correct and efficient work-stealing for weak memory models",
+ * PPoPP 2013). The owner thread pushes and pops at the bottom end, any other
+ * thread may steal from the top end. T has to be trivially copyable, usually
+ * it is a pointer.
+ *
+ * The buffer grows as needed; replaced buffers are kept until the deque is
+ * destroyed since a thief may still be reading them.
+ */
+
+template< typename T >
+struct StealingDeque {
+    using element = T;
+
+    StealingDeque( size_t capacity = 64 ) :
+        _top( 0 ), _bottom( 0 )
+    {
+        size_t size = 1;
+        while ( size < capacity )
+            size *= 2;
+        _buffers.emplace_back( new Buffer( size ) );
+        _buffer.store( _buffers.back().get(), std::memory_order_relaxed );
+    }
+
+    StealingDeque( const StealingDeque & ) = delete;
+    StealingDeque &operator=( const StealingDeque & ) = delete;
+
+    /* owner only */
+    void push( T x ) {
+        int64_t b = _bottom.load( std::memory_order_relaxed );
+        int64_t t = _top.load( std::memory_order_acquire );
+        Buffer *a = _buffer.load( std::memory_order_relaxed );
+        if ( b - t > int64_t( a->size ) - 1 )
+            a = grow( a, t, b );
+        a->put( b, x );
+        std::atomic_thread_fence( std::memory_order_release );
+        _bottom.store( b + 1, std::memory_order_relaxed );
+    }
+
+    /* owner only; takes the most recently pushed item */
+    bool pop( T &x ) {
+        int64_t b = _bottom.load( std::memory_order_relaxed ) - 1;
+        Buffer *a = _buffer.load( std::memory_order_relaxed );
+        _bottom.store( b, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t t = _top.load( std::memory_order_relaxed );
+
+        if ( t > b ) { // empty
+            _bottom.store( b + 1, std::memory_order_relaxed );
+            return false;
+        }
+        x = a->get( b );
+        if ( t < b )
+            return true;
+
+        // the last item, race with thieves
+        bool won = _top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed );
+        _bottom.store( b + 1, std::memory_order_relaxed );
+        return won;
+    }
+
+    /* any thread; takes the oldest item, fails on empty deque or lost race */
+    bool steal( T &x ) {
+        int64_t t = _top.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t b = _bottom.load( std::memory_order_acquire );
+        if ( t >= b )
+            return false;
+
+        Buffer *a = _buffer.load( std::memory_order_acquire );
+        x = a->get( t );
+        return _top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed );
+    }
+
+    /* approximate unless called by the owner */
+    bool empty() const {
+        return _bottom.load( std::memory_order_relaxed ) <= _top.load( std::memory_order_relaxed );
+    }
+    size_t size() const {
+        int64_t s = _bottom.load( std::memory_order_relaxed ) - _top.load( std::memory_order_relaxed );
+        return s > 0 ? s : 0;
+    }
+
+private:
+    struct Buffer {
+        size_t size;
+        std::unique_ptr< std::atomic< T >[] > items;
+
+        Buffer( size_t size ) : size( size ), items( new std::atomic< T >[ size ] ) {}
+
+        T get( int64_t i ) const {
+            return items[ i & ( size - 1 ) ].load( std::memory_order_relaxed );
+        }
+        void put( int64_t i, T x ) {
+            items[ i & ( size - 1 ) ].store( x, std::memory_order_relaxed );
+        }
+    };
+
+    Buffer *grow( Buffer *a, int64_t t, int64_t b ) {
+        _buffers.emplace_back( new Buffer( 2 * a->size ) );
+        Buffer *n = _buffers.back().get();
+        for ( int64_t i = t; i < b; ++i )
+            n->put( i, a->get( i ) );
+        _buffer.store( n, std::memory_order_release );
+        return n;
+    }
+
+    // thieves write only the top, keep it apart from the bottom
+    std::atomic< int64_t > _top;
+    char _separation[ BRICKS_CACHELINE ];
+    std::atomic< int64_t > _bottom;
+    std::atomic< Buffer * > _buffer;
+    std::vector< std::unique_ptr< Buffer > > _buffers; // owned by the owner
+};
+
+/*
+ * A bounded lock-free ring for exactly one producer and one consumer thread.
+ * The capacity is rounded up to a power of two. Each side caches the last
+ * seen index of the other side, so the shared cache line is only read when
+ * the ring looks full (producer) or empty (consumer).
+ */
+
+template< typename T >
+struct SpscRing {
+
+    SpscRing( size_t capacity = 1024 ) :
+        _write( 0 ), _readCache( 0 ),
+        _read( 0 ), _writeCache( 0 )
+    {
+        _size = 1;
+        while ( _size < capacity )
+            _size *= 2;
+        _items.reset( new T[ _size ] );
+    }
+
+    SpscRing( const SpscRing & ) = delete;
+    SpscRing &operator=( const SpscRing & ) = delete;
+
+    /* producer only; fails when the ring is full */
+    bool push( const T &x ) {
+        size_t w = _write.load( std::memory_order_relaxed );
+        if ( w - _readCache == _size ) {
+            _readCache = _read.load( std::memory_order_acquire );
+            if ( w - _readCache == _size )
+                return false;
+        }
+        _items[ w & ( _size - 1 ) ] = x;
+        _write.store( w + 1, std::memory_order_release );
+        return true;
+    }
+
+    /* consumer only; fails when the ring is empty */
+    bool pop( T &x ) {
+        size_t r = _read.load( std::memory_order_relaxed );
+        if ( r == _writeCache ) {
+            _writeCache = _write.load( std::memory_order_acquire );
+            if ( r == _writeCache )
+                return false;
+        }
+        x = _items[ r & ( _size - 1 ) ];
+        _read.store( r + 1, std::memory_order_release );
+        return true;
+    }
+
+    /* approximate unless called by the consumer */
+    bool empty() const {
+        return _read.load( std::memory_order_acquire ) == _write.load( std::memory_order_acquire );
+    }
+    size_t capacity() const {
+        return _size;
+    }
+
+private:
+    // the producer and the consumer side each live on their own cache line;
+    // padded rather than aligned, plain new does not honour the alignment
+    std::atomic< size_t > _write;
+    size_t _readCache;
+    char _producer[ BRICKS_CACHELINE ];
+    std::atomic< size_t > _read;
+    size_t _writeCache;
+    char _consumer[ BRICKS_CACHELINE ];
+    size_t _size;
+    std::unique_ptr< T[] > _items;
+};
+
+/*
+ * A bounded lock-free ring for any number of producers and one consumer.
+ * Each cell carries a sequence number which tells whether it is free for
+ * the producer of a given round or full for the consumer, so producers only
+ * compete for the write index and never wait for each other.
+ */
+
+template< typename T >
+struct MpscRing {
+
+    MpscRing( size_t capacity = 1024 ) :
+        _write( 0 ), _read( 0 )
+    {
+        _size = 1;
+        while ( _size < capacity )
+            _size *= 2;
+        _cells.reset( new Cell[ _size ] );
+        for ( size_t i = 0; i < _size; ++i )
+            _cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    MpscRing( const MpscRing & ) = delete;
+    MpscRing &operator=( const MpscRing & ) = delete;
+
+    /* any thread; fails when the ring is full, `x` is left intact then */
+    template< typename X >
+    bool push( X &&x ) {
+        size_t w = _write.load( std::memory_order_relaxed );
+        while ( true ) {
+            Cell &cell = _cells[ w & ( _size - 1 ) ];
+            size_t sequence = cell.sequence.load( std::memory_order_acquire );
+            intptr_t difference = intptr_t( sequence ) - intptr_t( w );
+            if ( difference == 0 ) {
+                if ( _write.compare_exchange_weak( w, w + 1, std::memory_order_relaxed ) ) {
+                    cell.item = std::forward< X >( x );
+                    cell.sequence.store( w + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if ( difference < 0 )
+                return false;
+            else
+                w = _write.load( std::memory_order_relaxed );
+        }
+    }
+
+    /* consumer only; fails when the ring is empty */
+    bool pop( T &x ) {
+        size_t r = _read.load( std::memory_order_relaxed );
+        Cell &cell = _cells[ r & ( _size - 1 ) ];
+        size_t sequence = cell.sequence.load( std::memory_order_acquire );
+        if ( sequence != r + 1 )
+            return false;
+        x = std::move( cell.item );
+        cell.sequence.store( r + _size, std::memory_order_release );
+        _read.store( r + 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    /* approximate, items being pushed are counted as well */
+    size_t size() const {
+        size_t r = _read.load( std::memory_order_relaxed );
+        size_t w = _write.load( std::memory_order_relaxed );
+        return w > r ? w - r : 0;
+    }
+    size_t capacity() const {
+        return _size;
+    }
+
+private:
+    struct Cell {
+        std::atomic< size_t > sequence;
+        T item;
+    };
+
+    // padded like SpscRing, the producers and the consumer do not share lines
+    std::atomic< size_t > _write;
+    char _producers[ BRICKS_CACHELINE ];
+    std::atomic< size_t > _read;
+    char _consumer[ BRICKS_CACHELINE ];
+    size_t _size;
+    std::unique_ptr< Cell[] > _cells;
+};
+
+/*
+ * An SPSC ring whose consumer can wait for the next item. It spins first,
+ * then yields and only then parks on a condition variable; the producer
+ * touches the mutex only when the consumer is parked. The spinning limit
+ * adapts: it grows when items come while spinning and shrinks on parking.
+ */
+
+template< typename T >
+struct ParkingRing {
+    enum { MinSpins = 64, MaxSpins = 16 * 1024, Yields = 16 };
+
+    ParkingRing( size_t capacity = 16 ) :
+        _ring( capacity ),
+        _parked( false ),
+        _spins( MinSpins )
+    {}
+
+    /* producer only; fails when the ring is full */
+    bool push( const T &x ) {
+        if ( !_ring.push( x ) )
+            return false;
+        // pairs with the fence in wait(), one of them sees the other
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( _parked.load( std::memory_order_relaxed ) ) {
+            std::lock_guard< std::mutex > _{ _mutex };
+            _wake.notify_one();
+        }
+        return true;
+    }
+
+    /* consumer only */
+    bool pop( T &x ) {
+        return _ring.pop( x );
+    }
+
+    /* consumer only; blocks until there is an item */
+    void wait( T &x ) {
+        for ( unsigned i = 0; i < _spins; ++i ) {
+            if ( _ring.pop( x ) ) {
+                _spins = std::min( unsigned( MaxSpins ), std::max( _spins, 2 * i + 1 ) );
+                return;
+            }
+            relax();
+        }
+        for ( int i = 0; i < Yields; ++i ) {
+            if ( _ring.pop( x ) )
+                return;
+            std::this_thread::yield();
+        }
+
+        _spins = std::max( unsigned( MinSpins ), _spins / 2 );
+        std::unique_lock< std::mutex > lock( _mutex );
+        while ( true ) {
+            _parked.store( true, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            if ( _ring.pop( x ) )
+                break;
+            _wake.wait( lock );
+        }
+        _parked.store( false, std::memory_order_relaxed );
+    }
+
+    size_t capacity() const {
+        return _ring.capacity();
+    }
+
+private:
+    static void relax() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+        __builtin_ia32_pause();
+#endif
+    }
+
+    SpscRing< T > _ring;
+    std::atomic< bool > _parked;
+    unsigned _spins; // touched by the consumer only
+    std::mutex _mutex;
+    std::condition_variable _wake;
+};
+
 }
 }
 
 #if __cplusplus >= 201103L
 
 #include <unistd.h> // alarm
+#include <string>
 #include <vector>
+#include <algorithm>
 
 namespace brick_test {
 namespace shmem {
@@ -700,6 +1059,253 @@ struct Utils {
     };
 };
 
+struct StealingDequeTest {
+    TEST(sequential) {
+        StealingDeque< int > d( 2 );
+        for ( int i = 0; i < 100; ++i )
+            d.push( i );
+        ASSERT_EQ( d.size(), 100u );
+
+        int x = 0;
+        ASSERT( d.steal( x ) );
+        ASSERT_EQ( x, 0 );
+        for ( int i = 99; i > 0; --i ) {
+            ASSERT( d.pop( x ) );
+            ASSERT_EQ( x, i );
+        }
+        ASSERT( !d.pop( x ) );
+        ASSERT( !d.steal( x ) );
+        ASSERT( d.empty() );
+    }
+
+    struct Thief : Thread {
+        StealingDeque< int > *deque;
+        std::vector< int > taken;
+
+        void main() {
+            int x;
+            while ( !interrupted() )
+                if ( deque->steal( x ) )
+                    taken.push_back( x );
+        }
+    };
+
+    TEST(stress) {
+        const int items = 256 * 1024;
+        StealingDeque< int > d;
+        std::vector< Thief > thieves( 4 );
+
+#if (defined( __unix ) || defined( POSIX )) && !defined( __divine__ ) // hm
+        alarm( 10 );
+#endif
+
+        for ( auto &t : thieves ) {
+            t.deque = &d;
+            t.start();
+        }
+
+        std::vector< int > taken;
+        int x;
+        for ( int i = 0; i < items; ++i ) {
+            d.push( i );
+            if ( i % 3 == 0 && d.pop( x ) )
+                taken.push_back( x );
+        }
+        while ( !d.empty() )
+            if ( d.pop( x ) )
+                taken.push_back( x );
+
+        for ( auto &t : thieves ) {
+            t.stop();
+            taken.insert( taken.end(), t.taken.begin(), t.taken.end() );
+        }
+
+        // each item is taken exactly once
+        std::sort( taken.begin(), taken.end() );
+        ASSERT_EQ( taken.size(), size_t( items ) );
+        for ( int i = 0; i < items; ++i )
+            ASSERT_EQ( taken[ i ], i );
+    }
+};
+
+struct SpscRingTest {
+    TEST(sequential) {
+        SpscRing< int > r( 5 );
+        ASSERT_EQ( r.capacity(), 8u );
+        ASSERT( r.empty() );
+
+        int x = 0;
+        ASSERT( !r.pop( x ) );
+        for ( int round = 0; round < 3; ++round ) {
+            for ( int i = 0; i < 8; ++i )
+                ASSERT( r.push( i ) );
+            ASSERT( !r.push( 8 ) );
+            for ( int i = 0; i < 8; ++i ) {
+                ASSERT( r.pop( x ) );
+                ASSERT_EQ( x, i );
+            }
+            ASSERT( !r.pop( x ) );
+        }
+    }
+
+    struct Producer : Thread {
+        SpscRing< int > *ring;
+        int items;
+
+        void main() {
+            for ( int i = 0; i < items; ++i )
+                while ( !ring->push( i ) )
+                    std::this_thread::yield();
+        }
+    };
+
+    TEST(stress) {
+        const int items = 1024 * 1024;
+        SpscRing< int > r( 64 );
+        Producer p;
+        p.ring = &r;
+        p.items = items;
+
+#if (defined( __unix ) || defined( POSIX )) && !defined( __divine__ ) // hm
+        alarm( 10 );
+#endif
+
+        p.start();
+        int x;
+        for ( int i = 0; i < items; ++i ) {
+            while ( !r.pop( x ) )
+                std::this_thread::yield();
+            ASSERT_EQ( x, i );
+        }
+        p.join();
+        ASSERT( r.empty() );
+    }
+};
+
+struct ParkingRingTest {
+    TEST(sequential) {
+        ParkingRing< int > r( 3 );
+        ASSERT_EQ( r.capacity(), 4u );
+
+        int x;
+        ASSERT( !r.pop( x ) );
+        for ( int i = 0; i < 4; ++i )
+            ASSERT( r.push( i ) );
+        ASSERT( !r.push( 4 ) );
+        for ( int i = 0; i < 4; ++i ) {
+            r.wait( x );
+            ASSERT_EQ( x, i );
+        }
+        ASSERT( !r.pop( x ) );
+    }
+
+    struct Echo : Thread {
+        ParkingRing< int > *in, *out;
+        int items;
+
+        void main() {
+            int x;
+            for ( int i = 0; i < items; ++i ) {
+                in->wait( x );
+                while ( !out->push( -x ) )
+                    std::this_thread::yield();
+            }
+        }
+    };
+
+    // round trips with a window of requests in flight; the sleeps make
+    // both sides park now and then
+    TEST(pingPong) {
+        const int items = 64 * 1024, window = 4;
+        ParkingRing< int > requests( window ), responses( window );
+        Echo e;
+        e.in = &requests;
+        e.out = &responses;
+        e.items = items;
+
+#if (defined( __unix ) || defined( POSIX )) && !defined( __divine__ ) // hm
+        alarm( 10 );
+#endif
+        e.start();
+
+        int sent = 0, x;
+        for ( ; sent < window; ++sent )
+            ASSERT( requests.push( sent + 1 ) );
+        for ( int i = 0; i < items; ++i ) {
+            if ( i % 4096 == 0 )
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            responses.wait( x );
+            ASSERT_EQ( x, -( i + 1 ) );
+            if ( sent < items )
+                ASSERT( requests.push( ++sent ) );
+        }
+        e.join();
+        ASSERT( !responses.pop( x ) );
+    }
+};
+
+struct MpscRingTest {
+    TEST(sequential) {
+        MpscRing< std::string > r( 3 );
+        ASSERT_EQ( r.capacity(), 4u );
+
+        std::string x;
+        ASSERT( !r.pop( x ) );
+        for ( int round = 0; round < 3; ++round ) {
+            for ( int i = 0; i < 4; ++i )
+                ASSERT( r.push( std::to_string( i ) ) );
+            x = "left";
+            ASSERT( !r.push( std::move( x ) ) );
+            ASSERT_EQ( x, "left" );
+            ASSERT_EQ( r.size(), 4u );
+            for ( int i = 0; i < 4; ++i ) {
+                ASSERT( r.pop( x ) );
+                ASSERT_EQ( x, std::to_string( i ) );
+            }
+            ASSERT( !r.pop( x ) );
+        }
+    }
+
+    struct Producer : Thread {
+        MpscRing< int > *ring;
+        int id, items;
+
+        void main() {
+            for ( int i = 0; i < items; ++i )
+                while ( !ring->push( id * items + i ) )
+                    std::this_thread::yield();
+        }
+    };
+
+    TEST(stress) {
+        const int items = 256 * 1024, producers = 3;
+        MpscRing< int > r( 64 );
+        std::vector< Producer > p( producers );
+
+#if (defined( __unix ) || defined( POSIX )) && !defined( __divine__ ) // hm
+        alarm( 10 );
+#endif
+
+        for ( int i = 0; i < producers; ++i ) {
+            p[ i ].ring = &r;
+            p[ i ].id = i;
+            p[ i ].items = items;
+            p[ i ].start();
+        }
+        // items of each producer come in order
+        std::vector< int > next( producers, 0 );
+        int x;
+        for ( int i = 0; i < items * producers; ++i ) {
+            while ( !r.pop( x ) )
+                std::this_thread::yield();
+            ASSERT_EQ( x % items, next[ x / items ]++ );
+        }
+        for ( auto &t : p )
+            t.join();
+        ASSERT( !r.pop( x ) );
+    }
+};
+
 }
 }
 
@@ -1134,6 +1740,121 @@ struct FIFO : BenchmarkGroup
     BENCHMARK(p_64b) { param< padded< 64 > >(); }
 };
 
+/* all threads share one locked queue */
+struct LockedHandle {
+    std::shared_ptr< LockedQueue< int > > q;
+    void push( int x ) { q->push( x ); }
+    bool pop( int &x ) { x = q->pop(); return x != 0; }
+};
+
+/* each thread owns a deque and steals from random victims when it runs dry */
+struct StealingHandle {
+    std::shared_ptr< std::vector< std::unique_ptr< StealingDeque< int > > > > all;
+    StealingDeque< int > *own;
+    unsigned seed;
+
+    void push( int x ) { own->push( x ); }
+    bool pop( int &x ) {
+        if ( own->pop( x ) )
+            return true;
+        seed = seed * 1103515245 + 12345;
+        for ( unsigned i = 0; i < all->size(); ++i ) {
+            auto &victim = (*all)[ ( seed + i ) % all->size() ];
+            if ( victim.get() != own && victim->steal( x ) )
+                return true;
+        }
+        return false;
+    }
+};
+
+/* expands a binary tree of items, like the load workers do with packages */
+template< typename H >
+struct ExpandThread : Thread {
+    H handle;
+    int items;
+    std::atomic< int > *done;
+
+    void main() {
+        int local = 0, x;
+        while ( done->load( std::memory_order_relaxed ) < items - 1 ) {
+            if ( !handle.pop( x ) ) {
+                done->fetch_add( local );
+                local = 0;
+                continue;
+            }
+            if ( 2 * x < items )
+                handle.push( 2 * x );
+            if ( 2 * x + 1 < items )
+                handle.push( 2 * x + 1 );
+            if ( ++local == 64 ) {
+                done->fetch_add( local );
+                local = 0;
+            }
+        }
+    }
+};
+
+struct Stealing : BenchmarkGroup
+{
+    Stealing() {
+        x.type = Axis::Quantitative;
+        x.name = "threads";
+        x.min = 1;
+        x.max = 64;
+        x.log = true;
+        x.step = 2;
+
+        y.type = Axis::Qualitative;
+        y.name = "type";
+        y.min = 0;
+        y.max = 1;
+        y.step = 1;
+        y._render = []( int i ) {
+            switch (i) {
+                case 0: return "locked";
+                case 1: return "stealing";
+                default: ASSERT_UNREACHABLE_F( "bad i = %d", i );
+            }
+        };
+    }
+
+    std::string describe() {
+        return "category:shmem category:stealing";
+    }
+
+    template< typename H >
+    void expand( std::vector< H > handles ) {
+        std::atomic< int > done( 0 );
+        std::vector< ExpandThread< H > > t( p );
+
+        handles[ 0 ].push( 1 );
+        for ( int i = 0; i < p; ++i ) {
+            t[ i ].handle = handles[ i ];
+            t[ i ].items = 1 << 20;
+            t[ i ].done = &done;
+        }
+        for ( auto &w : t )
+            w.start();
+        for ( auto &w : t )
+            w.join();
+    }
+
+    BENCHMARK(tree) {
+        if ( q == 0 ) {
+            LockedHandle h{ std::make_shared< LockedQueue< int > >() };
+            return expand( std::vector< LockedHandle >( p, h ) );
+        }
+
+        auto all = std::make_shared< std::vector< std::unique_ptr< StealingDeque< int > > > >();
+        std::vector< StealingHandle > handles;
+        for ( int i = 0; i < p; ++i ) {
+            all->emplace_back( new StealingDeque< int > );
+            handles.push_back( StealingHandle{ all, all->back().get(), unsigned( i ) } );
+        }
+        expand( handles );
+    }
+};
+
 }
 }
 
@@ -118,16 +118,26 @@ bool Client::add( std::string slaveName, std::string *description ) {
 
     channel->send( message );
     InputMessage response;
+    channel->peek( response );
 
-    if ( description ) {
-        response >> *description;
-        channel->receive( response );
+    // older slaves do not offer any wire format
+    int format = int( brick::net::WireFormat::Fixed );
+    std::string refusal;
+    if ( response.count() ) {
+        if ( response.tag< Code >() == Code::OK )
+            response >> format;
+        else
+            response >> ( description ? *description : refusal );
     }
-    else
-        channel->receiveHeader( response );
+    channel->receive( response );
 
     if ( response.tag< Code >() == Code::OK ) {
         _idCounter++;
+        wireFormat( std::min( wireFormat(), brick::net::WireFormat( format ) ) );
+        // the output of the slave is received into it
+        channel->slab( true );
+        // requests may be sent to the slave back to back
+        channel->setNoDelay();
 
         std::string slaveAddress( net().peerAddress( *channel ) );
         Line slave = std::make_shared< Peer >(
@@ -159,6 +169,7 @@ bool Client::removeAll() {
 
     connections().clear();
     _names.clear();
+    wireFormat( brick::net::WireFormat::Compact );
     return true;
 }
 
@@ -180,12 +191,40 @@ std::string Client::status( const std::string &machine ) {
     return description;
 }
 
+std::vector< ChannelTraffic > Client::traffic( const std::string &machine ) {
+    Channel channel = connect( machine.c_str(), true );
+    if ( !channel || !*channel )
+        return {};
+
+    OutputMessage message( MessageType::Control );
+    message.tag( Code::Traffic );
+
+    channel->send( message );
+
+    InputMessage response;
+    std::string rows;
+    response >> rows;
+
+    channel->receive( response );
+    if ( response.tag< Code >() != Code::Traffic )
+        throw ResponseException( { Code::Traffic }, response.tag< Code >() );
+
+    std::vector< ChannelTraffic > result( rows.size() / sizeof( ChannelTraffic ) );
+    std::memcpy( result.data(), rows.data(), result.size() * sizeof( ChannelTraffic ) );
+    return result;
+}
+
 void Client::run( int argc, char **argv, const void *initData, size_t initDataLength ) {
     try {
+        auto begin = std::chrono::steady_clock::now();
         if ( !establish( argc, argv, initData, initDataLength ) ) {
             std::cerr << "could not establish the network" << std::endl;
             return;
         }
+        _setupTime = std::chrono::duration_cast< std::chrono::milliseconds >(
+            std::chrono::steady_clock::now() - begin );
+        std::cerr << "world of " << worldSize() << " formed in "
+                  << _setupTime.count() << " ms" << std::endl;
 
         _quit = false;
         registerSignalHandler();
@@ -235,62 +274,53 @@ bool Client::dissolve() {
     message.tag( Code::PrepareToLeave );
 
     for ( const auto &slave : connections().values() ) {
-        slave->master()->send( message );
-        InputMessage response;
-        slave->master()->receiveHeader( response );
-
-        if ( response.tag< Code >() == Code::OK )
-            continue;
-        if ( response.tag< Code >() == Code::Refuse ) {
-            std::cout << "! slave " << info( slave ) << " refused to prepare to leave" << std::endl;
+        if ( !ask( slave->master(), message ) )
             break;
-        }
-        throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
     }
+    if ( !answers() )
+        std::cout << "! slave " << info( _refused ) << " refused to prepare to leave" << std::endl;
 
     message.tag( Code::Leave );
     for ( const auto &slave : connections().values() ) {
-        slave->master()->send( message );
-        InputMessage response;
-        slave->master()->receiveHeader( response );
-
-        if ( response.tag< Code >() == Code::OK )
-            continue;
-        if ( response.tag< Code >() == Code::Refuse ) {
-            std::cout << "! slave " << info( slave ) << " refused to leave" << std::endl;
+        if ( !ask( slave->master(), message ) )
             break;
-        }
-        throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
     }
+    if ( !answers() )
+        std::cout << "! slave " << info( _refused ) << " refused to leave" << std::endl;
+
     connections().clear();
     _names.clear();
+    wireFormat( brick::net::WireFormat::Compact );
     return true;
 }
 
 bool Client::initWorld() {
     int world = worldSize();
+    int format = int( wireFormat() );
 
     OutputMessage message( MessageType::Control );
     message.tag( Code::Peers );
     message << world;
+    // every slave offered at least this format, so none of them is too old
+    if ( wireFormat() != brick::net::WireFormat::Fixed )
+        message << format;
 
     for ( const auto &slave : connections().values() ) {
-        slave->master()->send( message );
-        InputMessage response;
-        slave->master()->receiveHeader( response );
-
-        if ( response.tag< Code >() == Code::OK )
-            continue;
-        if ( response.tag < Code >() == Code::Refuse ) {
-            std::cerr << "slave '" << slave->name() << "' refused to beign grouped" << std::endl;
-            return false;
-        }
-        throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
+        if ( !ask( slave->master(), message ) )
+            break;
+    }
+    if ( !answers() ) {
+        std::cerr << "slave " << info( _refused ) << " refused to beign grouped" << std::endl;
+        return false;
     }
+    for ( const auto &slave : connections().values() )
+        slave->master()->format( wireFormat() );
     return true;
 }
 
 bool Client::connectAll() {
+    // a slave connects to the peers of higher ranks, which never wait for
+    // it, so all of them may be asked at once
     for ( auto i = connections().vbegin(); i != connections().vend(); ++i ) {
 
         auto p = i;
@@ -304,50 +334,25 @@ bool Client::connectAll() {
             message.tag( Code::ConnectTo );
             message << rank << slaveName << address;
 
-            (*i)->master()->send( message );
-            InputMessage response;
-            (*i)->master()->receiveHeader( response );
-
-            switch( response.tag< Code >() ) {
-            case Code::OK:
-                break;
-            case Code::Refuse:
+            if ( !ask( (*i)->master(), message ) )
                 return false;
-            default:
-                throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
-            }
         }
     }
+    if ( !answers() )
+        return false;
 
     OutputMessage message( MessageType::Control );
     message.tag( Code::Grouped );
     for ( const auto &slave : connections().values() ) {
-        slave->master()->send( message );
-        InputMessage response;
-        slave->master()->receiveHeader( response );
-
-        switch( response.tag< Code >() ) {
-        case Code::OK:
-            break;
-        case Code::Refuse:
+        if ( !ask( slave->master(), message ) )
             return false;
-        default:
-            throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
-        }
     }
-
-    return true;
+    return answers();
 }
 
 bool Client::start( int argc, char **argv, const void *initData, size_t initDataLength ) {
-    if ( initData ) {
-        OutputMessage data( MessageType::Control );
-        data.tag( Code::InitialData );
-        data.add( initData, initDataLength );
-
-        if ( !sendAll( data, ChannelType::Master ) )
-            throw SendAllException();
-    }
+    if ( initData && !sendData( initData, initDataLength ) )
+        return false;
 
     OutputMessage message( MessageType::Control );
     message.tag( Code::Run );
@@ -355,19 +360,11 @@ bool Client::start( int argc, char **argv, const void *initData, size_t initData
         message.add( argv[ i ], std::strlen( argv[ i ] ) );
 
     for ( const auto &slave : connections().values() ) {
-        slave->master()->send( message );
-        InputMessage response;
-        slave->master()->receiveHeader( response );
-
-        switch( response.tag< Code >() ) {
-        case Code::OK:
-            break;
-        case Code::Refuse:
+        if ( !ask( slave->master(), message ) )
             return false;
-        default:
-            throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
-        }
     }
+    if ( !answers() )
+        return false;
 
     message.clear();
     message.tag( Code::Start );
@@ -376,14 +373,85 @@ bool Client::start( int argc, char **argv, const void *initData, size_t initData
     return true;
 }
 
+// the data go in chunks, so that slaves broadcasting along the tree pass
+// them on while receiving them
+bool Client::sendData( const void *data, size_t length ) {
+    std::vector< Channel > targets;
+    OutputMessage announcement( MessageType::Control );
+    announcement << length;
+
+    if ( _broadcast == Broadcast::Tree ) {
+        Line root = connections().lockedFind( 1 );
+        if ( !root )
+            return false;
+        targets.push_back( root->master() );
+        announcement.tag( Code::SpreadData );
+    }
+    else {
+        for ( const auto &slave : connections().values() )
+            targets.push_back( slave->master() );
+        announcement.tag( Code::InitialData );
+    }
+
+    if ( !sendAll( announcement, targets ) )
+        throw SendAllException();
+
+    const char *begin = static_cast< const char * >( data );
+    for ( size_t offset = 0; offset < length; offset += _chunkSize ) {
+        OutputMessage chunk( MessageType::Control );
+        chunk.tag( Code::DataChunk );
+        chunk.add( const_cast< char * >( begin ) + offset, std::min( _chunkSize, length - offset ) );
+
+        if ( !sendAll( chunk, targets ) )
+            throw SendAllException();
+    }
+    return true;
+}
+
+// sends a request; the sequential orchestration waits for its answer
+bool Client::ask( Channel channel, OutputMessage &message ) {
+    if ( _pending.empty() )
+        _refused.reset();
+    channel->send( message );
+    ++_pending[ channel ];
+    if ( _orchestration == Orchestration::Sequential )
+        return answers();
+    return true;
+}
+
+// waits for answers to all requests sent so far; false if any was refused
+bool Client::answers() {
+    while ( !_pending.empty() ) {
+        std::vector< Channel > channels;
+        channels.reserve( _pending.size() );
+        for ( const auto &p : _pending )
+            channels.push_back( p.first );
+        probe( channels, &Client::discardMessage, -1, false );
+    }
+    return !_refused;
+}
+
+bool Client::answer( Channel channel, Code code ) {
+    auto p = _pending.find( channel );
+    if ( p == _pending.end() )
+        throw ResponseException( { Code::Done, Code::Error, Code::Renegade }, code );
+    if ( code == Code::Refuse && !_refused )
+        _refused = channel;
+    if ( !--p->second )
+        _pending.erase( p );
+    return true;
+}
+
 void Client::reset() {
     _idCounter = 1;
     _done = 0;
+    _pending.clear();
     _quit = true;
     _established = false;
 
     connections().clear();
     _names.clear();
+    wireFormat( brick::net::WireFormat::Compact );
 }
 
 void Client::reset( Address address ) {
@@ -401,6 +469,10 @@ bool Client::processControl( Channel channel ) {
     channel->peek( message );
 
     switch ( message.tag< Code >() ) {
+    case Code::OK:
+    case Code::Refuse:
+        channel->receiveHeader( message );
+        return answer( channel, message.tag< Code >() );
     case Code::Done:
         channel->receiveHeader( message );
         return done();
@@ -431,7 +503,11 @@ void Client::processDisconnected( Channel channel ) {
 
 void Client::processOutput( Channel channel ) {
     InputMessage message;
-    channel->receive( message );
+    brick::net::Slab *slab = channel->slab();
+    if ( slab )
+        channel->receive( message, slab->allocator() );
+    else
+        channel->receive( message );
 
     std::ostream &out = message.tag< Output >() == Output::Standard ?
         std::cout :
@@ -442,9 +518,10 @@ void Client::processOutput( Channel channel ) {
         out.flush();
     } );
 
-    message.cleanup< char >( []( char *d ) {
-        delete[] d;
-    } );
+    if ( !slab )
+        message.cleanup< char >( []( char *d ) {
+            delete[] d;
+        } );
 }
 
 bool Client::done() {
@@ -1,6 +1,8 @@
 //#include <signal.h>
 #include <unordered_map>
+#include <map>
 #include <string>
+#include <chrono>
 
 #include "message.h"
 #include "communicator.h"
@@ -8,6 +10,12 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+// how the client talks to the slaves while forming and dissolving the world
+enum class Orchestration {
+    Sequential, // wait for each answer before asking the next slave
+    Parallel    // ask all slaves at once and collect the answers as they come
+};
+
 class Client : public Communicator {
     using InputMessage = brick::net::InputMessage;
     using OutputMessage = brick::net::OutputMessage;
@@ -17,6 +25,8 @@ public:
         Communicator( port, false )
     {
         this->channels( channels );
+        // lowered by each added slave to the best format all of them know
+        wireFormat( brick::net::WireFormat::Compact );
     }
 
     ~Client() {
@@ -33,9 +43,27 @@ public:
     bool removeAll();
 
     std::string status( const std::string & );
+    // empty unless the daemon works on a job
+    std::vector< ChannelTraffic > traffic( const std::string & );
 
     void run( int, char **, const void * = nullptr, size_t = 0);
 
+    void orchestration( Orchestration o ) {
+        _orchestration = o;
+    }
+    // the tree sends the initial data to the first slave only
+    void broadcasting( Broadcast b ) {
+        _broadcast = b;
+    }
+    // the initial data are sent in pieces of this size
+    void chunkSize( size_t size ) {
+        _chunkSize = std::max( size, size_t( 1 ) );
+    }
+    // time spent by forming the world and starting the job
+    std::chrono::milliseconds setupTime() const {
+        return _setupTime;
+    }
+
 private:
 
     bool establish( int, char **, const void *, size_t );
@@ -44,6 +72,11 @@ private:
     bool initWorld();
     bool connectAll();
     bool start( int, char **, const void *, size_t );
+    bool sendData( const void *, size_t );
+
+    bool ask( Channel, OutputMessage & );
+    bool answers();
+    bool answer( Channel, Code );
 
     void reset();
     void reset( Address );
@@ -66,6 +99,13 @@ private:
     static int _signal;
     bool _quit = false;
     bool _established = false;
+    Orchestration _orchestration = Orchestration::Sequential;
+    Broadcast _broadcast = Broadcast::Flat;
+    size_t _chunkSize = 1 << 20;
+    std::chrono::milliseconds _setupTime{ 0 };
+
+    std::map< Channel, int > _pending; // unanswered requests
+    Channel _refused;
 
     static Channel _flag;
     Channel _watchDog;
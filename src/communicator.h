@@ -13,6 +13,46 @@
 #ifndef COMMUNICATOR_H_
 #define COMMUNICATOR_H_
 
+// how a message for all peers gets to them
+enum class Broadcast {
+    Flat, // the sender sends a copy to each peer
+    Tree  // along a binomial tree, each peer passes the message on
+};
+
+// Binomial tree over ranks 1..size rooted at `root`. The children come by
+// descending size of their subtrees: sends of a parent are serial, so the
+// deepest part of the tree has to get the message first.
+struct BinomialTree {
+    static std::vector< int > children( int rank, int root, int size ) {
+        int self = relative( rank, root, size );
+        int bit = 1;
+        while ( bit <= self )
+            bit <<= 1;
+
+        // the lowest bit roots the biggest subtree
+        std::vector< int > result;
+        for ( ; self + bit < size; bit <<= 1 )
+            result.push_back( absolute( self + bit, root, size ) );
+        return result;
+    }
+
+    static int parent( int rank, int root, int size ) {
+        int self = relative( rank, root, size );
+        int bit = 1;
+        while ( bit * 2 <= self )
+            bit <<= 1;
+        return absolute( self - bit, root, size );
+    }
+
+private:
+    static int relative( int rank, int root, int size ) {
+        return ( rank - root + size ) % size;
+    }
+    static int absolute( int self, int root, int size ) {
+        return ( self + root - 1 ) % size + 1;
+    }
+};
+
 struct Communicator {
 protected:
 
@@ -27,6 +67,7 @@ public:
     Communicator( const char *port, bool autobind ) :
         _rank( 0 ),
         _worldSize( 0 ),
+        _wireFormat( brick::net::WireFormat::Fixed ),
         _net( port, autobind )
     {}
     virtual ~Communicator() = default;
@@ -40,6 +81,9 @@ public:
     int channels() const {
         return _channels;
     }
+    brick::net::WireFormat wireFormat() const {
+        return _wireFormat;
+    }
     const std::string &name() const {
         return _name;
     }
@@ -66,6 +110,9 @@ protected:
     void channels( int c ) {
         _channels = c;
     }
+    void wireFormat( brick::net::WireFormat f ) {
+        _wireFormat = f;
+    }
     void name( std::string n ) {
         _name.swap( n );
     }
@@ -112,13 +159,18 @@ protected:
             channel->readMutex().lock();
 
         int processed = 0;
+        bool control = false;
         _net.poll(
             channels,
             [this] ( brick::net::Socket s ) {
                 processIncoming( std::make_shared< Socket >( std::move( s ) ) );
             },
             [&,this] ( Channel channel ) {
-                return process( channel, processed, applicator );
+                // a control handler may have read the data of channels ready
+                // in the same round, see Daemon::awaitData; others do not
+                if ( control && !channel->readable() )
+                    return true;
+                return process( channel, processed, applicator, control );
             },
             timeout,
             listen
@@ -126,34 +178,72 @@ protected:
         return processed;
     }
 
+    // only the ready channels are locked; one prober per event set
+    template< typename Ap >
+    int probe( brick::net::EventSet< Channel > &events, Ap applicator, int timeout ) {
+        using Result = brick::net::EventSet< Channel >::Result;
+
+        int processed = 0;
+        bool control = false;
+        events.wait(
+            [&,this] ( const Channel &channel ) {
+                std::lock_guard< std::mutex > _{ channel->readMutex() };
+                // edges may come for already consumed data
+                if ( !channel->readable() )
+                    return Result::Drained;
+                if ( !process( channel, processed, applicator, control ) )
+                    return Result::Stop;
+                // only the prober touches its set, see processDisconnected
+                if ( channel->closed() ) {
+                    events.remove( channel );
+                    return Result::Drained;
+                }
+                return channel->readable() ? Result::Ready : Result::Drained;
+            },
+            timeout
+        );
+        return processed;
+    }
+
 private:
 
     template< typename Ap >
-    bool process( Channel channel, int &processed, Ap applicator ) {
-        if ( channel->closed() ) {
-            processDisconnected( std::move( channel ) );
-            return true;
-        }
+    bool process( Channel channel, int &processed, Ap applicator, bool &control ) {
+        // coalesced messages are already buffered, take all of them
         InputMessage message;
-        channel->peek( message );
-
-        switch ( message.category< MessageType >() ) {
-        case MessageType::Data:
-            ++processed;
-            if ( !takeBool( applicator, std::move( channel ) ) )
-                return false;
-            break;
-        case MessageType::Control:
-            if ( !processControl( std::move( channel ) ) )
-                return false;
-            break;
-        case MessageType::Output:
-            processOutput( std::move( channel ) );
-            break;
-        default:
-            channel->receiveHeader( message );
-            break;
-        }
+        do {
+            if ( channel->closed() ) {
+                processDisconnected( std::move( channel ) );
+                return true;
+            }
+            message.clear();
+            channel->peek( message );
+
+            switch ( message.category< MessageType >() ) {
+            case MessageType::Data:
+                ++processed;
+                if ( !takeBool( applicator, channel ) )
+                    return false;
+                break;
+            case MessageType::Control:
+                control = true;
+                if ( !processControl( channel ) )
+                    return false;
+                break;
+            case MessageType::Output:
+                processOutput( channel );
+                break;
+            case MessageType::Collective:
+                processCollective( channel );
+                break;
+            default:
+                channel->receiveHeader( message );
+                break;
+            }
+            // segments received into the slab are not used any more
+            if ( brick::net::Slab *slab = channel->slab() )
+                slab->release();
+        } while ( channel->pending() );
         return true;
     }
 
@@ -167,6 +257,11 @@ private:
         InputMessage message;
         channel->receiveHeader( message );
     }
+    // a peer which is done may send its part of a reduce early
+    virtual void processCollective( Channel channel ) {
+        InputMessage message;
+        channel->receiveHeader( message );
+    }
     virtual void processDisconnected( Channel channel ) {
         connections().lockedErase( channel->rank() );
     }
@@ -202,6 +297,7 @@ private:
     int _rank;
     int _worldSize;
     int _channels;
+    brick::net::WireFormat _wireFormat;
     Connections _connections;
     Network _net;
     std::string _name;
@@ -213,6 +309,40 @@ namespace netTest {
 
 using namespace brick::net;
 
+struct Tree {
+
+    static int subtree( int rank, int root, int size ) {
+        int nodes = 1;
+        for ( int child : BinomialTree::children( rank, root, size ) )
+            nodes += subtree( child, root, size );
+        return nodes;
+    }
+
+    static void check( int size ) {
+        for ( int root = 1; root <= size; ++root ) {
+            ASSERT_EQ( subtree( root, root, size ), size );
+            for ( int rank = 1; rank <= size; ++rank ) {
+                int previous = size;
+                for ( int child : BinomialTree::children( rank, root, size ) ) {
+                    ASSERT_EQ( BinomialTree::parent( child, root, size ), rank );
+                    int nodes = subtree( child, root, size );
+                    ASSERT_LEQ( nodes, previous );
+                    previous = nodes;
+                }
+            }
+        }
+    }
+
+    TEST(order) {
+        ASSERT( BinomialTree::children( 1, 1, 8 ) == std::vector< int >( { 2, 3, 5 } ) );
+        ASSERT( BinomialTree::children( 1, 1, 5 ) == std::vector< int >( { 2, 3, 5 } ) );
+        ASSERT( BinomialTree::children( 3, 3, 5 ) == std::vector< int >( { 4, 5, 2 } ) );
+        ASSERT( BinomialTree::children( 2, 1, 8 ) == std::vector< int >( { 4, 6 } ) );
+        check( 5 );
+        check( 8 );
+    }
+};
+
 struct Test {
 
     using Socket = ::Socket;
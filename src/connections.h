@@ -45,15 +45,13 @@ private:
 
 using Channel = std::shared_ptr< Socket >;
 
+// data channels are numbered from Data up to Communicator::channels() - 1,
+// their count is given by the client when enslaving the daemons
 enum class ChannelType : int {
 
     All = -2,
     Master = -1,
-    Data01 = 0, Data02, Data03, Data04, Data05, Data06, Data07, Data08, Data09, Data10,
-    Data11,     Data12, Data13, Data14, Data15, Data16, Data17, Data18, Data19, Data20,
-    Data21,     Data22, Data23, Data24, Data25, Data26, Data27, Data28, Data29, Data30,
-
-    _offsetToZero = 2
+    Data = 0
 };
 
 
@@ -72,8 +70,12 @@ struct ChannelID {
     ChannelType asType() const {
         return static_cast< ChannelType >( _channel );
     }
+    // index into a dense table which starts with All and Master
     int asIndex() const {
-        return _channel + static_cast< int >( ChannelType::_offsetToZero );
+        return _channel - static_cast< int >( ChannelType::All );
+    }
+    static size_t tableSize( int channels ) {
+        return channels - static_cast< int >( ChannelType::All );
     }
 private:
     int _channel;
@@ -4,6 +4,8 @@
 #include <sys/types.h>
 #include <chrono>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <future>
 
 #include "daemon.h"
@@ -12,6 +14,14 @@ constexpr std::chrono::milliseconds operator""_ms( unsigned long long ms ) {
     return std::chrono::milliseconds{ ms };
 }
 
+// counters of a channel of the job, placed in memory shared by the daemon
+// and its working child
+struct TrafficSlot {
+    int32_t peer;
+    int32_t channel;
+    brick::net::Traffic traffic;
+};
+
 std::unique_ptr< Daemon > Daemon::_self;
 
 Daemon::Daemon( const char *port, int (*main)( int, char ** ), std::string logFile ) :
@@ -44,6 +54,7 @@ bool Daemon::hasInstance() {
 
 void Daemon::exit( int code ) {
     NOTE();
+    flush();
     Line master = connections().lockedFind( 0 );
     if ( !master ) {
         Logger::log( "inaccessible master" );
@@ -83,6 +94,7 @@ void Daemon::run( bool detach ) {
 bool Daemon::daemonize() {
     int pid, sid;
 
+    Logger::flush();
     pid = ::fork();
     if ( pid < 0 )
         throw brick::net::SystemException( "fork" );
@@ -221,6 +233,12 @@ bool Daemon::processControl( Channel channel ) {
     case Code::InitialData:
         initData( message, std::move( channel ) );
         break;
+    case Code::SpreadData:
+        spreadData( message, std::move( channel ) );
+        break;
+    case Code::DataChunk:
+        dataChunk( message, std::move( channel ) );
+        break;
     case Code::Run:
         run( message, std::move( channel ) );
         break;
@@ -247,6 +265,10 @@ bool Daemon::processControl( Channel channel ) {
         cleanup();
         status( std::move( channel ) );
         break;
+    case Code::Traffic:
+        cleanup();
+        traffic( std::move( channel ) );
+        break;
     case Code::Shutdown:
         cleanup();
         shutdown( std::move( channel ) );
@@ -270,6 +292,8 @@ bool Daemon::processControl( Channel channel ) {
             Code::DataLine,
             Code::Grouped,
             Code::InitialData,
+            Code::SpreadData,
+            Code::DataChunk,
             Code::Run,
             Code::PrepareToLeave,
             Code::Leave,
@@ -285,6 +309,36 @@ bool Daemon::processControl( Channel channel ) {
     return true;
 }
 
+void Daemon::processCollective( Channel channel ) {
+    InputMessage message;
+    channel->receive( message );
+    std::string value;
+    message.process( [&]( char *data, size_t size ) {
+        value.append( data, size );
+    } );
+    message.cleanup< char >( []( char *d ) {
+        delete[] d;
+    } );
+    std::lock_guard< std::mutex > _{ _earlyMutex };
+    _early[ channel.get() ].push_back( std::move( value ) );
+}
+
+// called with the read mutex of the channel held, values of a peer come in order
+bool Daemon::early( Channel channel, void *value, size_t size ) {
+    std::lock_guard< std::mutex > _{ _earlyMutex };
+    auto i = _early.find( channel.get() );
+    if ( i == _early.end() || i->second.empty() )
+        return false;
+    std::string &front = i->second.front();
+    if ( front.size() != size )
+        throw brick::net::DataTransferException( "receive", size, front.size() );
+    std::memcpy( value, front.data(), size );
+    i->second.pop_front();
+    return true;
+}
+
+// a dead channel leaves its event set in Communicator::probe, the set
+// belongs to the thread which probes it
 void Daemon::processDisconnected( Channel dead ) {
     switch ( _state ) {
     case State::Leaving:
@@ -313,6 +367,9 @@ void Daemon::processDisconnected( Channel dead ) {
 }
 
 void Daemon::processIncoming( Channel incoming ) {
+    // control messages go out in several writes, do not let them wait for
+    // acks; buildCache turns the delay back on for the job
+    incoming->setNoDelay();
     processControl( std::move( incoming ) );
 }
 
@@ -338,6 +395,7 @@ void Daemon::enslave( InputMessage &message, Channel channel ) {
 
 
     response.tag( Code::OK );
+    response << int( brick::net::WireFormat::Compact );
     channel->send( response );
 
     rank( i );
@@ -376,8 +434,12 @@ void Daemon::startGrouping( InputMessage &message, Channel channel ) {
 
     OutputMessage response( MessageType::Control );
     int parameter;
+    int format = int( brick::net::WireFormat::Fixed );
 
+    // older clients send the size of the world only
     message >> parameter;
+    if ( message.count() > 1 )
+        message >> format;
     channel->receive( message );
 
     if ( _state != State::Enslaved ) {
@@ -390,6 +452,8 @@ void Daemon::startGrouping( InputMessage &message, Channel channel ) {
 
     _state = State::FormingGroup;
     worldSize( parameter );
+    wireFormat( brick::net::WireFormat( format ) );
+    channel->format( wireFormat() );
 }
 
 void Daemon::connecting( InputMessage &message, Channel channel ) {
@@ -422,8 +486,14 @@ void Daemon::connecting( InputMessage &message, Channel channel ) {
 
         bool ok = true;
 
+        // all requests go out first so that the round trips overlap
+        std::vector< Channel > dataLines;
+        dataLines.reserve( channels() );
+        for ( int i = 0; i < channels(); ++i )
+            dataLines.push_back( requestLine( peerAddress, LineType::Data, i ) );
+
         for ( int i = 0; i < channels(); ++i ) {
-            Channel dataLine = connectLine( peerAddress, LineType::Data, i );
+            Channel dataLine = acceptedLine( std::move( dataLines[ i ] ) );
             if ( !dataLine ) {
                 ok = false;
                 break;
@@ -458,13 +528,15 @@ void Daemon::join( InputMessage &message, Channel channel ) {
 
     response.tag( Code::OK );
     channel->send( response );
+    channel->format( wireFormat() );
 
     std::string address( net().peerAddress( *channel ) );
     Line peer = std::make_shared< Peer >(
         peerId,
         std::move( peerName ),
         address.c_str(),
-        std::move( channel )
+        std::move( channel ),
+        channels()
     );
 
     connections().lockedInsert( peerId, std::move( peer ) );
@@ -478,10 +550,16 @@ void Daemon::addDataLine( InputMessage &message, Channel channel ) {
 
     int peerId;
     int channelId;
+    int count = channels();
     message >> peerId >> channelId;
+    // older daemons do not send their count of data channels
+    if ( message.count() > 2 )
+        message >> count;
     channel->receive( message );
 
-    if ( _state == State::FormingGroup ) {
+    if ( count != channels() || channelId < 0 || channelId >= channels() )
+        Logger::log( "refused data line " + std::to_string( channelId ) + " of " + std::to_string( count ) );
+    else if ( _state == State::FormingGroup ) {
         Line peer = connections().lockedFind( peerId );
         if ( peer ) {
             peer->openDataChannel( channel, channelId );
@@ -489,6 +567,8 @@ void Daemon::addDataLine( InputMessage &message, Channel channel ) {
         }
     }
     channel->send( response );
+    if ( response.tag< Code >() == Code::OK )
+        channel->format( wireFormat() );
 }
 
 void Daemon::grouped( Channel channel ) {
@@ -507,6 +587,9 @@ void Daemon::grouped( Channel channel ) {
     response.tag( Code::OK );
     channel->send( response );
 
+    shareTraffic();
+    // the writer thread would not survive in the child
+    Logger::flush();
     int pid = ::fork();
     if ( pid == -1 )
         throw brick::net::SystemException( "fork" );
@@ -520,16 +603,99 @@ void Daemon::grouped( Channel channel ) {
 
 void Daemon::initData( InputMessage &message, Channel channel ) {
     NOTE();
-    if ( _state != State::Grouped ) {
-        Logger::log( "command InitialData came at bad moment" );
+    announcedData( message, std::move( channel ) );
+}
+
+// chunks are passed down the tree of slaves as they come
+void Daemon::spreadData( InputMessage &message, Channel channel ) {
+    NOTE();
+    if ( !announcedData( message, std::move( channel ) ) )
+        return;
+
+    OutputMessage announcement( MessageType::Control );
+    announcement.tag( Code::SpreadData );
+    announcement << _initDataLength;
+
+    for ( int child : children( MainSlave ) ) {
+        Line line = connections().lockedFind( child );
+        if ( !line || !line->masterChannel() )
+            throw NetworkException( "no line to peer #" + std::to_string( child ) );
+        line->master()->send( announcement );
+        _initDataSinks.push_back( line->master() );
+    }
+}
+
+// the data go to an unlinked temporary file, so they need not fit into memory
+static brick::mmap::MMap temporaryMap( size_t length, const char *name = "initdata" ) {
+    const char *directory = std::getenv( "TMPDIR" );
+    std::string path = std::string( directory ? directory : "/tmp" ) + "/" + name + ".XXXXXX";
+
+    int fd = ::mkstemp( &path.front() );
+    if ( fd < 0 )
+        throw brick::net::SystemException( "mkstemp" );
+    ::unlink( path.c_str() );
+    if ( ::ftruncate( fd, length ) != 0 ) {
+        ::close( fd );
+        throw brick::net::SystemException( "ftruncate" );
+    }
+    using brick::mmap::ProtectMode;
+    return brick::mmap::MMap( fd, ProtectMode::Read | ProtectMode::Write | ProtectMode::Shared );
+}
+
+bool Daemon::announcedData( InputMessage &message, Channel channel ) {
+    size_t length;
+    message >> length;
+    channel->receive( message );
+
+    if ( _state != State::Grouped || _initDataSource ) {
+        Logger::log( std::string( "command " ) + codeToString( message.tag< Code >() ) + " came at bad moment" );
+        return false;
+    }
+
+    if ( length )
+        _initData = temporaryMap( length );
+    _initDataLength = length;
+    _initDataReceived = 0;
+    _initDataSource = std::move( channel );
+    return true;
+}
+
+void Daemon::dataChunk( InputMessage &message, Channel channel ) {
+    size_t offset = _initDataReceived;
+    size_t length = message.count() ? message.header().segments[ 0 ] : 0;
+
+    if ( channel != _initDataSource || message.count() != 1 || offset + length > _initDataLength ) {
+        Logger::log( "unexpected chunk of data from " + info( channel ) );
+        channel->receiveHeader( message );
         return;
     }
 
-    channel->receive( message, [this]( size_t length ) {
-        _initData.reset( new char[ length ] );
-        _initDataLength = length;
-        return _initData.get();
+    char *chunk = _initData.data() + offset;
+    channel->receive( message, [chunk]( size_t ) {
+        return chunk;
     } );
+
+    OutputMessage forward( MessageType::Control );
+    forward.tag( Code::DataChunk );
+    forward.add( static_cast< void * >( chunk ), length );
+    for ( auto &sink : _initDataSinks ) {
+        std::lock_guard< std::mutex > _{ sink->writeMutex() };
+        sink->send( forward );
+    }
+
+    _initDataReceived = offset + length;
+}
+
+// the job may not start before the rest of the data come, as their line is
+// shared with messages of the job; nothing else is sent on it before Start
+void Daemon::awaitData() {
+    while ( _initDataReceived < _initDataLength ) {
+        InputMessage message;
+        _initDataSource->peek( message );
+        if ( message.tag< Code >() != Code::DataChunk )
+            throw ResponseException( { Code::DataChunk }, message.tag< Code >() );
+        dataChunk( message, _initDataSource );
+    }
 }
 
 void Daemon::run( InputMessage &message, Channel channel ) {
@@ -543,6 +709,7 @@ void Daemon::run( InputMessage &message, Channel channel ) {
             channel->send( response );
             return;
         }
+        awaitData();
         response.tag( Code::OK );
         channel->send( response );
 
@@ -648,6 +815,24 @@ void Daemon::status( Channel channel ) {
     channel->send( response );
 }
 
+void Daemon::traffic( Channel channel ) {
+    NOTE();
+
+    std::vector< ChannelTraffic > rows;
+    if ( _traffic.valid() ) {
+        const char *base = _traffic.data();
+        uint64_t count = *reinterpret_cast< const uint64_t * >( base );
+        const TrafficSlot *slots = reinterpret_cast< const TrafficSlot * >( base + sizeof( uint64_t ) );
+        for ( uint64_t i = 0; i < count; ++i )
+            rows.push_back( { rank(), slots[ i ].peer, slots[ i ].channel, slots[ i ].traffic.snapshot() } );
+    }
+
+    OutputMessage response( MessageType::Control );
+    response.tag( Code::Traffic );
+    response << rows;
+    channel->send( response );
+}
+
 void Daemon::shutdown( Channel channel ) {
     NOTE();
     OutputMessage response( MessageType::Control );
@@ -706,6 +891,13 @@ void Daemon::setDefault( bool wait ) {
     }
     rank( 0 );
     worldSize( 0 );
+    wireFormat( brick::net::WireFormat::Fixed );
+    _initData.unmap();
+    _initDataLength = 0;
+    _initDataReceived = 0;
+    _initDataSource.reset();
+    _initDataSinks.clear();
+    _traffic.unmap();
 }
 
 void Daemon::waitForChild( bool wait ) {
@@ -732,6 +924,10 @@ void Daemon::waitForChild( bool wait ) {
 }
 
 Channel Daemon::connectLine( Address &address, LineType type, int channelId ) {
+    return acceptedLine( requestLine( address, type, channelId ) );
+}
+
+Channel Daemon::requestLine( Address &address, LineType type, int channelId ) {
     OutputMessage request( MessageType::Control );
     std::string name = this->name();
     int r = rank();
@@ -743,17 +939,23 @@ Channel Daemon::connectLine( Address &address, LineType type, int channelId ) {
         break;
     case LineType::Data:
         request.tag( Code::DataLine );
-        request << r << channelId;
+        request << r << channelId << channels();
         break;
     }
 
     Channel channel = connect( address );
+    channel->setNoDelay();
     channel->send( request );
+    return channel;
+}
 
+Channel Daemon::acceptedLine( Channel channel ) {
     InputMessage response;
     channel->receive( response );
-    if ( response.tag< Code >() == Code::OK )
+    if ( response.tag< Code >() == Code::OK ) {
+        channel->format( wireFormat() );
         return channel;
+    }
     if ( response.tag< Code >() == Code::Refuse )
         return Channel();
     throw ResponseException( { Code::OK, Code::Refuse }, response.tag< Code >() );
@@ -795,9 +997,36 @@ void Daemon::redirectOutput( const char *s, size_t length, Output type ) {
     master->master()->send( message );
 }
 
+// the child counts the traffic of the job into a shared mapping, so the
+// parent can answer Traffic while the job runs
+void Daemon::shareTraffic() {
+    std::vector< std::tuple< int, int, Channel > > channels;
+    for ( Line &line : connections().values() ) {
+        if ( line->masterChannel() )
+            channels.emplace_back( line->rank(), int( ChannelType::Master ), line->master() );
+        int id = int( ChannelType::Data );
+        for ( auto &ch : line->data() ) {
+            if ( ch )
+                channels.emplace_back( line->rank(), id, ch );
+            ++id;
+        }
+    }
+
+    _traffic = temporaryMap( sizeof( uint64_t ) + channels.size() * sizeof( TrafficSlot ), "traffic" );
+    char *base = _traffic.data();
+    *reinterpret_cast< uint64_t * >( base ) = channels.size();
+    TrafficSlot *slots = reinterpret_cast< TrafficSlot * >( base + sizeof( uint64_t ) );
+    for ( size_t i = 0; i < channels.size(); ++i ) {
+        TrafficSlot *slot = new ( slots + i ) TrafficSlot;
+        slot->peer = std::get< 0 >( channels[ i ] );
+        slot->channel = std::get< 1 >( channels[ i ] );
+        std::get< 2 >( channels[ i ] )->traffic( &slot->traffic );
+    }
+}
+
 void Daemon::buildCache()
 {
-    _cache.resize( channels() + 2 );
+    _cache.resize( ChannelID::tableSize( channels() ) );
     {
         std::vector< Channel > cache;
         for ( Line &line : connections().values() ) {
@@ -807,6 +1036,10 @@ void Daemon::buildCache()
                     cache.push_back( ch );
             }
         }
+        for ( auto &channel : cache ) {
+            channel->slab( true );
+            channel->setNoDelay( false );
+        }
         _cache[ ChannelID( ChannelType::All ).asIndex() ] = std::move( cache );
     }
     {
@@ -830,6 +1063,75 @@ void Daemon::buildCache()
     }
 }
 
+void Daemon::coalesce( size_t threshold, std::chrono::microseconds deadline ) {
+    _coalescing = threshold > 0;
+    for ( auto &channel : _cache.at( ChannelID( ChannelType::All ).asIndex() ) ) {
+        // messages to the client are not worth waiting for
+        if ( channel->rank() == 0 )
+            continue;
+        std::lock_guard< std::mutex > _{ channel->writeMutex() };
+        channel->coalesce( threshold, deadline );
+    }
+}
+
+void Daemon::polling( brick::net::Polling p ) {
+    _events.clear();
+    if ( p == brick::net::Polling::Poll )
+        return;
+    for ( const auto &cache : _cache ) {
+        std::unique_ptr< brick::net::EventSet< Channel > > events( new brick::net::EventSet< Channel > );
+        for ( const Channel &channel : cache )
+            events->add( channel );
+        _events.push_back( std::move( events ) );
+    }
+}
+
+void Daemon::flush( ChannelID chID, bool expiredOnly ) {
+    if ( !_coalescing )
+        return;
+    auto now = brick::net::SendBuffer::Clock::now();
+    for ( auto &channel : _cache.at( chID.asIndex() ) ) {
+        std::lock_guard< std::mutex > _{ channel->writeMutex() };
+        if ( expiredOnly )
+            channel->flushExpired( now );
+        else
+            channel->flush();
+    }
+}
+
+bool Daemon::relay( int root, OutputMessage &message, ChannelID chID ) {
+    if ( _broadcast == Broadcast::Flat )
+        return true;
+    message.from( root );
+    message.to( ALL );
+
+    bool result = true;
+    for ( int child : children( root ) ) {
+        Channel channel = findChannel( child, chID );
+        if ( !channel ) {
+            result = false;
+            continue;
+        }
+        std::lock_guard< std::mutex > _{ channel->writeMutex() };
+        try {
+            channel->send( message );
+        } catch ( ... ) {
+            result = false;
+        }
+    }
+    return result;
+}
+
+// the tree is built over ranks relative to the root; children of a node are
+// the ranks which differ from it in a single bit above its highest one
+std::vector< int > Daemon::children( int root ) const {
+    return BinomialTree::children( rank(), root, worldSize() );
+}
+
+int Daemon::parent( int root ) const {
+    return BinomialTree::parent( rank(), root, worldSize() );
+}
+
 void Daemon::table() {
     std::ostringstream out;
     out << "==[" << name() << " (" << rank() << ")]==" << std::endl;
@@ -1,7 +1,11 @@
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 
 #include <brick-shmem.h>
+#include <brick-mmap.h>
 
 #include "communicator.h"
 #include "message.h"
@@ -54,8 +58,9 @@ public:
         return rank() == MainSlave;
     }
 
-    char *data() const {
-        return _initData.get();
+    // the initial data are mapped from a temporary file
+    const char *data() const {
+        return _initData.valid() ? _initData.data() : nullptr;
     }
     size_t dataSize() const {
         return _initDataLength;
@@ -63,12 +68,60 @@ public:
 
     template< typename Ap >
     int probe( Ap applicator, ChannelID chID = ChannelType::Master, int timeout = -1 ) {
+        if ( !_events.empty() )
+            return Communicator::probe( *_events.at( chID.asIndex() ), applicator, timeout );
         return Communicator::probe( _cache.at( chID.asIndex() ), applicator, timeout, false );
     }
+
+    // probe keeps channels registered in epoll instead of passing them to poll
+    void polling( brick::net::Polling );
+    brick::net::Polling polling() const {
+        return _events.empty() ? brick::net::Polling::Poll : brick::net::Polling::Epoll;
+    }
     bool sendAll( OutputMessage &message, ChannelID chID = ChannelType::Master ) {
         return Communicator::sendAll( message, _cache.at( chID.asIndex() ) );
     }
 
+    // sendAll which lets the peers pass the message on if broadcasting
+    // along the tree; the receiver of such message has to call relay
+    bool broadcast( OutputMessage &message, ChannelID chID = ChannelType::Master ) {
+        if ( _broadcast == Broadcast::Flat )
+            return sendAll( message, chID );
+        return relay( rank(), message, chID );
+    }
+    // passes a message broadcast by `root` on to the children of this rank
+    bool relay( int root, OutputMessage &, ChannelID = ChannelType::Master );
+
+    void broadcasting( Broadcast b ) {
+        _broadcast = b;
+    }
+    Broadcast broadcasting() const {
+        return _broadcast;
+    }
+
+    // combines values of all peers by `op` along the tree; only `root` gets
+    // the whole result, the others get the result of their subtree;
+    // nobody else may receive from the channels meanwhile; data which came
+    // before the values are dropped, control messages throw
+    template< typename T, typename Op >
+    T reduce( T value, Op op, int root = MainSlave, ChannelID chID = ChannelType::Master ) {
+        for ( int child : children( root ) )
+            value = op( value, collect< T >( child, chID ) );
+        if ( rank() != root )
+            contribute( parent( root ), value, chID );
+        return value;
+    }
+    // reduce after which each peer gets the whole result
+    template< typename T, typename Op >
+    T allreduce( T value, Op op, ChannelID chID = ChannelType::Master ) {
+        value = reduce( value, op, MainSlave, chID );
+        if ( rank() != MainSlave )
+            value = collect< T >( parent( MainSlave ), chID );
+        for ( int child : children( MainSlave ) )
+            contribute( child, value, chID );
+        return value;
+    }
+
     bool sendTo( int rank, OutputMessage &message, ChannelID chID = ChannelType::Master ) {
         return sendTo( findChannel( rank, chID ), message );
     }
@@ -78,10 +131,18 @@ public:
         message.from( rank() );
         message.to( channel->rank() );
         std::lock_guard< std::mutex > _{ channel->writeMutex() };
-        channel->send( message );
+        channel->post( message );
         return true;
     }
 
+    // sendTo gathers messages for each peer and sends up to `threshold` bytes at once
+    void coalesce( size_t threshold, std::chrono::microseconds deadline = std::chrono::milliseconds( 1 ) );
+    bool coalescing() const {
+        return _coalescing;
+    }
+    // sends gathered messages; either all of them or those waiting too long
+    void flush( ChannelID chID = ChannelType::All, bool expiredOnly = false );
+
     bool receive( int rank, InputMessage &message, ChannelID chID = ChannelType::Master ) {
         return receive( findChannel( rank, chID ), message );
     }
@@ -141,12 +202,66 @@ private:
         return peers[ rank ];
     }
 
+    // binomial tree over ranks rooted at `root`, see BinomialTree
+    std::vector< int > children( int root ) const;
+    int parent( int root ) const;
+
+    template< typename T >
+    T collect( int rank, ChannelID chID ) {
+        static_assert( std::is_trivially_copyable< T >::value, "T has to be trivially copyable" );
+        Channel channel = findChannel( rank, chID );
+        if ( !channel )
+            throw NetworkException( "no channel to peer #" + std::to_string( rank ) );
+
+        std::lock_guard< std::mutex > _{ channel->readMutex() };
+        T value;
+        if ( early( channel, &value, sizeof( T ) ) )
+            return value;
+
+        InputMessage message;
+        while ( true ) {
+            message.clear();
+            channel->peek( message );
+            MessageType type = message.category< MessageType >();
+            if ( type == MessageType::Collective )
+                break;
+            // nobody would learn about a Shutdown or an Error lost here
+            if ( type == MessageType::Control ) {
+                std::string code = codeToString( message.tag< Code >() );
+                Logger::log( "got " + code + " from " + info( channel ) + " while waiting for a collective" );
+                throw NetworkException( "unexpected " + code + " within a collective" );
+            }
+            channel->receiveHeader( message );
+            if ( brick::net::Slab *slab = channel->slab() )
+                slab->release();
+        }
+        channel->receiveInto( message, &value, 1 );
+        return value;
+    }
+
+    template< typename T >
+    void contribute( int rank, const T &value, ChannelID chID ) {
+        Channel channel = findChannel( rank, chID );
+        if ( !channel )
+            throw NetworkException( "no channel to peer #" + std::to_string( rank ) );
+
+        OutputMessage message( MessageType::Collective );
+        message.from( this->rank() );
+        message.to( rank );
+        message << value;
+        // not posted, the peer waits for it
+        std::lock_guard< std::mutex > _{ channel->writeMutex() };
+        channel->send( message );
+    }
+
     bool daemonize();
     void loop();
     void runMain();
 
     bool processControl( Channel ) override;
+    void processCollective( Channel ) override;
     void processDisconnected( Channel ) override;
+    bool early( Channel, void *, size_t );
     void processIncoming( Channel ) override;
 
     void enslave( InputMessage &, Channel );
@@ -157,6 +272,10 @@ private:
     void addDataLine( InputMessage &, Channel );
     void grouped( Channel );
     void initData( InputMessage &, Channel );
+    void spreadData( InputMessage &, Channel );
+    bool announcedData( InputMessage &, Channel );
+    void dataChunk( InputMessage &, Channel );
+    void awaitData();
     void run( InputMessage &, Channel );
     void prepare( Channel );
     void leave( Channel );
@@ -164,6 +283,7 @@ private:
     void error( Channel );
     void renegade( InputMessage &, Channel );
     void status( Channel );
+    void traffic( Channel );
     void shutdown( Channel );
     void forceShutdown();
     void forceReset();
@@ -174,6 +294,8 @@ private:
     void waitForChild( bool );
 
     Channel connectLine( Address &, LineType, int = 0 );
+    Channel requestLine( Address &, LineType, int = 0 );
+    Channel acceptedLine( Channel );
 
     void becomeParent( Channel );
     void becomeChild( Channel );
@@ -182,6 +304,7 @@ private:
     void redirectOutput( const char *, size_t, Output );
 
     void buildCache();
+    void shareTraffic();
     const char *status() const;
 
     State _state;
@@ -190,13 +313,23 @@ private:
     bool _quit;
     bool _runMain;
     int ( *_main )( int, char ** );
-    std::unique_ptr< char[] > _initData;
     std::vector< std::unique_ptr< char[] > > _arguments;
+    mutable brick::mmap::MMap _initData;
+    brick::mmap::MMap _traffic; // TrafficSlot of each channel, shared with the child
     size_t _initDataLength = 0;
+    size_t _initDataReceived = 0;
+    Channel _initDataSource;
+    std::vector< Channel > _initDataSinks;
+    bool _coalescing = false;
+    Broadcast _broadcast = Broadcast::Flat;
 
     static std::unique_ptr< Daemon > _self;
 
     std::vector< std::vector< Channel > > _cache;
+    std::vector< std::unique_ptr< brick::net::EventSet< Channel > > > _events;
+    // values of collectives which came before collect asked for them
+    std::mutex _earlyMutex;
+    std::unordered_map< const Socket *, std::deque< std::string > > _early;
 };
 
 #endif
@@ -9,6 +9,10 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <iomanip>
 #include <algorithm>
 #include <thread>
 
@@ -46,6 +50,10 @@ void dummyMain() {
 void run( int argc, char **argv, const Meta &meta ) {
     try {
         Client c{ meta.port.c_str(), meta.threads };
+        if ( meta.parallelSetup )
+            c.orchestration( Orchestration::Parallel );
+        if ( meta.tree )
+            c.broadcasting( Broadcast::Tree );
 
         std::vector< std::pair< std::string, std::string > > problematic;
         for ( const auto &host : meta.hosts ) {
@@ -128,7 +136,14 @@ template<
     typename Package
 >
 void startWorker( const Meta &meta ) {
-    Workers< W, Package > w( meta.threads, meta.workLoad, meta.selection );
+    Workers< W, Package > w( meta.threads, meta.workLoad, meta.selection,
+                             meta.stealing ? QueuePolicy::Stealing : QueuePolicy::Locked,
+                             meta.exhaustive, meta.batch,
+                             meta.sharded ? SetPolicy::Sharded : SetPolicy::Shared, meta.window,
+                             meta.fingerprints ? StoragePolicy::Fingerprints :
+                             meta.compression ? StoragePolicy::Tree : StoragePolicy::Exact );
+    if ( !meta.results.empty() )
+        w.results( meta.results, algorithmName( meta.algorithm ) );
     w.run();
 }
 
@@ -136,6 +151,12 @@ int mainD( int argc, char **argv ) {
 
     Meta meta( argc, argv, true );
 
+    if ( meta.coalesce )
+        Daemon::instance().coalesce( meta.coalesce );
+    if ( meta.epoll )
+        Daemon::instance().polling( brick::net::Polling::Epoll );
+    if ( meta.tree )
+        Daemon::instance().broadcasting( Broadcast::Tree );
 
     switch ( meta.algorithm ) {
     case Algorithm::LoadDedicated:
@@ -144,6 +165,9 @@ int mainD( int argc, char **argv ) {
     case Algorithm::LoadShared:
         startWorker< load::Shared, Package >( meta );
         break;
+    case Algorithm::LoadIO:
+        startWorker< load::IO, Package >( meta );
+        break;
     case Algorithm::PingDedicated:
         startWorker< ping::Dedicated, Package >( meta );
         break;
@@ -156,6 +180,9 @@ int mainD( int argc, char **argv ) {
     case Algorithm::LongLoadShared:
         startWorker< load::Shared, LongPackage >( meta );
         break;
+    case Algorithm::LongLoadIO:
+        startWorker< load::IO, LongPackage >( meta );
+        break;
     case Algorithm::LongPingDedicated:
         startWorker< ping::Dedicated, LongPackage >( meta );
         break;
@@ -184,13 +211,89 @@ void start( const Meta &meta ) {
         std::cout << *m << ": " << ( *r ? "started" : "failed" ) << std::endl;
 }
 
+void printTraffic( const std::vector< ChannelTraffic > &rows ) {
+    using brick::net::Access;
+    using brick::net::Traffic;
+    const int sent = int( Access::Write ), received = int( Access::Read );
+
+    std::map< int, std::map< int, uint64_t > > matrix;
+    std::set< int > peers;
+    for ( const auto &row : rows ) {
+        matrix[ row.rank ][ row.peer ] += row.counters.bytes[ sent ];
+        peers.insert( row.peer );
+    }
+
+    std::cout << "bytes sent by the job (rows to columns):" << std::endl << "     ";
+    for ( int peer : peers )
+        std::cout << std::setw( 13 ) << ( "#" + std::to_string( peer ) );
+    std::cout << std::endl;
+    for ( const auto &from : matrix ) {
+        std::cout << std::setw( 5 ) << ( "#" + std::to_string( from.first ) );
+        for ( int peer : peers ) {
+            auto bytes = from.second.find( peer );
+            std::cout << std::setw( 13 ) << ( bytes == from.second.end() ? 0 : bytes->second );
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "channels:" << std::endl;
+    for ( const auto &row : rows ) {
+        const auto &c = row.counters;
+        std::cout << "  #" << row.rank << " -> #" << row.peer << " "
+                  << ( row.channel == int( ChannelType::Master ) ? "master" : "data " + std::to_string( row.channel ) )
+                  << ": sent " << c.messages[ sent ] << " / " << c.bytes[ sent ] << " B"
+                  << ", received " << c.messages[ received ] << " / " << c.bytes[ received ] << " B"
+                  << ", blocked " << c.blocked / 1000000.0 << " ms"
+                  << ", queued " << c.queued << " B" << std::endl;
+    }
+
+    std::cout << "messages by type and size (count of messages from 2^n bytes):" << std::endl;
+    std::pair< MessageType, const char * > types[] = {
+        { MessageType::Data, "data" },
+        { MessageType::Control, "control" },
+        { MessageType::Output, "output" },
+        { MessageType::Collective, "collective" }
+    };
+    std::map< int, Traffic::Snapshot > nodes; // value-initialized, zeroes
+    for ( const auto &row : rows ) {
+        auto &sizes = nodes[ row.rank ].sizes;
+        for ( int d = 0; d < 2; ++d )
+            for ( int t = 0; t < Traffic::CATEGORIES; ++t )
+                for ( int b = 0; b < Traffic::BUCKETS; ++b )
+                    sizes[ d ][ t ][ b ] += row.counters.sizes[ d ][ t ][ b ];
+    }
+    for ( const auto &node : nodes ) {
+        for ( const auto &type : types ) {
+            int t = uint8_t( type.first ) % Traffic::CATEGORIES;
+            for ( int d : { sent, received } ) {
+                std::ostringstream line;
+                for ( int b = 0; b < Traffic::BUCKETS; ++b )
+                    if ( uint64_t n = node.second.sizes[ d ][ t ][ b ] )
+                        line << " 2^" << b << ": " << n;
+                if ( !line.str().empty() )
+                    std::cout << "  #" << node.first << " " << type.second
+                              << ( d == sent ? " sent:" : " received:" ) << line.str() << std::endl;
+            }
+        }
+    }
+}
+
 void status( const Meta &meta ) {
     Client c{ meta.port.c_str() };
 
+    std::vector< ChannelTraffic > traffic;
     for ( const auto &host : meta.hosts ) {
         std::cout << host << ": ";
         std::cout << c.status( host ) << std::endl;
+
+        try {
+            for ( auto &row : c.traffic( host ) )
+                traffic.push_back( row );
+        } catch ( const std::exception & ) {
+        }
     }
+    if ( !traffic.empty() )
+        printTraffic( traffic );
 }
 
 int main( int argc, char **argv ) {
@@ -219,6 +322,8 @@ int main( int argc, char **argv ) {
             start( meta );
             break;
         case Command::Daemon:
+            if ( !meta.notes )
+                Logger::threshold( Severity::Info );
             Daemon::instance( meta.port.c_str(), &mainD, meta.logFile ).run( meta.detach );
             break;
         case Command::Run:
@@ -1,34 +1,208 @@
 #include "logger.h"
 
-#include <fstream>
 #include <ctime>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
 
-void Logger::log( std::string record, bool erase ) {
-    if ( _file.empty() )
-        return;
+#include <brick-shmem.h>
+
+namespace {
+
+struct Record {
+    std::time_t time = 0;
+    bool child = false;
+    std::string text;
+};
+
+struct Sink {
+
+    void file( std::string address ) {
+        std::lock_guard< std::mutex > _{ _mutex };
+        _file = std::move( address );
+        if ( _file.empty() )
+            return;
+        int fd = ::open( _file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if ( fd >= 0 )
+            ::close( fd );
+    }
+
+    bool active() {
+        return !_file.empty();
+    }
+
+    void push( std::string text ) {
+        if ( !_running.load( std::memory_order_acquire ) )
+            start();
+
+        Record r;
+        r.time = std::time( nullptr );
+        r.child = _child;
+        r.text = std::move( text );
+        if ( !_ring->push( std::move( r ) ) ) {
+            _dropped.fetch_add( 1, std::memory_order_relaxed );
+            _wake.notify_one();
+        }
+        // the writer comes by itself in a while, hurry it only when needed
+        else if ( _ring->size() > _ring->capacity() / 2 )
+            _wake.notify_one();
+    }
+
+    void start() {
+        std::lock_guard< std::mutex > _{ _mutex };
+        if ( _running.load( std::memory_order_relaxed ) )
+            return;
+        if ( !_ring )
+            _ring.reset( new brick::shmem::MpscRing< Record >( _limit ) );
+        if ( !_registered ) {
+            std::atexit( &Logger::flush );
+            _registered = true;
+        }
+        _fd = ::open( _file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+        _stop = false;
+        _writer = std::thread( [this] { run(); } );
+        _running.store( true, std::memory_order_release );
+    }
+
+    void stop() {
+        std::unique_lock< std::mutex > lock( _mutex );
+        if ( !_running.load( std::memory_order_relaxed ) )
+            return;
+        _stop = true;
+        lock.unlock();
+        _wake.notify_one();
+        _writer.join();
+
+        lock.lock();
+        if ( _fd >= 0 )
+            ::close( _fd );
+        _fd = -1;
+        _running.store( false, std::memory_order_release );
+    }
+
+    void limit( size_t records ) {
+        std::lock_guard< std::mutex > _{ _mutex };
+        if ( !_ring )
+            _limit = records;
+    }
+
+    void becomeChild() {
+        _child = true;
+    }
+
+    unsigned long dropped() const {
+        return _droppedTotal.load( std::memory_order_relaxed );
+    }
+
+private:
+    void run() {
+        std::unique_lock< std::mutex > lock( _mutex );
+        while ( !_stop ) {
+            drain();
+            _wake.wait_for( lock, std::chrono::milliseconds( 20 ) );
+        }
+        drain();
+    }
 
-    std::time_t t = std::time( nullptr );
-    char timestamp[ 20 ] = {};
-    std::strftime( timestamp, 20, "%Y-%m-%d %H:%M:%S", std::localtime( &t ) );
+    // called with the mutex held, which makes the writer the only consumer
+    void drain() {
+        Record r;
+        std::string batch;
+        while ( _ring->pop( r ) ) {
+            batch += prefix( r.time );
+            if ( r.child )
+                batch += "(child) ";
+            batch += r.text;
+            batch += '\n';
+        }
+        if ( unsigned long dropped = _dropped.exchange( 0, std::memory_order_relaxed ) ) {
+            _droppedTotal.fetch_add( dropped, std::memory_order_relaxed );
+            batch += prefix( std::time( nullptr ) );
+            batch += std::to_string( dropped ) + " records dropped\n";
+        }
 
-    std::ofstream file( _file, erase ? std::ios::out : std::ios::app );
+        const char *data = batch.data();
+        size_t length = batch.size();
+        while ( length && _fd >= 0 ) {
+            ssize_t written = ::write( _fd, data, length );
+            if ( written < 0 )
+                break;
+            data += written;
+            length -= written;
+        }
+    }
 
-    file << "[" << timestamp << "] ";
-    if ( _child )
-        file << "(child) ";
-    file << record << std::endl;
+    // records come in bursts, so the formatted second is reused
+    const std::string &prefix( std::time_t t ) {
+        if ( t != _second ) {
+            std::tm local;
+            char timestamp[ 24 ] = {};
+            ::localtime_r( &t, &local );
+            std::strftime( timestamp, sizeof( timestamp ), "[%Y-%m-%d %H:%M:%S] ", &local );
+            _prefix = timestamp;
+            _second = t;
+        }
+        return _prefix;
+    }
+
+    std::string _file;
+    bool _child = false;
+    size_t _limit = 4096;
+    std::unique_ptr< brick::shmem::MpscRing< Record > > _ring;
+    std::atomic< unsigned long > _dropped{ 0 };
+    std::atomic< unsigned long > _droppedTotal{ 0 };
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::thread _writer;
+    std::atomic< bool > _running{ false };
+    bool _stop = false;
+    bool _registered = false;
+    int _fd = -1;
+
+    std::time_t _second = -1;
+    std::string _prefix;
+};
+
+// never destroyed, records may come from destructors of other statics
+Sink &sink() {
+    static Sink *s = new Sink;
+    return *s;
+}
+
+}
+
+void Logger::record( std::string text ) {
+    if ( !sink().active() )
+        return;
+    sink().push( std::move( text ) );
 }
 
 void Logger::file( std::string address ) {
-    _file = std::move( address );
-    if ( !_file.empty() && _file.find_last_of( '.' ) == std::string::npos )
-        _file += ".log";
-    log( "logging started", true );
+    if ( !address.empty() && address.find_last_of( '.' ) == std::string::npos )
+        address += ".log";
+    sink().file( std::move( address ) );
+    log( "logging started" );
 }
 
 void Logger::becomeChild() {
-    _child = true;
+    sink().becomeChild();
+}
+
+void Logger::flush() {
+    sink().stop();
+}
+
+void Logger::limit( size_t records ) {
+    sink().limit( records );
+}
+
+unsigned long Logger::dropped() {
+    return sink().dropped();
 }
 
-std::string Logger::_file;
-bool Logger::_child( false );
\ No newline at end of file
+std::atomic< Severity > Logger::_threshold( Severity::Note );
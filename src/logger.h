@@ -1,25 +1,51 @@
 #include <string>
+#include <atomic>
 
 #ifndef LOGGER_H
 #define LOGGER_H
 
+enum class Severity {
+    Note, // traces of daemon functions, see NOTE()
+    Info
+};
+
+// records go to a ring and a writer thread appends them to the file in
+// batches; when the ring is full, records are dropped and counted
 struct Logger {
 
-    static void log( std::string text ) {
-        log( std::move( text ), false );
+    static void log( std::string text, Severity severity = Severity::Info ) {
+        if ( enabled( severity ) )
+            record( std::move( text ) );
+    }
+    static bool enabled( Severity severity ) {
+        return severity >= _threshold.load( std::memory_order_relaxed );
+    }
+    static void threshold( Severity severity ) {
+        _threshold.store( severity, std::memory_order_relaxed );
     }
+    // count of records the ring can hold, set it before the first record
+    static void limit( size_t );
+    static unsigned long dropped();
+
     static void file( std::string );
     static void becomeChild();
+
+    // writes out waiting records and stops the writer, which starts again
+    // with the next record; call it before fork
+    static void flush();
 private:
-    static void log( std::string, bool );
-    static std::string _file;
-    static bool _child;
+    static void record( std::string );
+    static std::atomic< Severity > _threshold;
 };
 
-//#ifdef DEBUG
-#define NOTE() Logger::log( __PRETTY_FUNCTION__ )
-//#else
-//#define NOTE() do {} while(false)
-//#endif
+// notes are compiled out of release builds unless LOGGER_NOTES is defined
+#if defined( NDEBUG ) && !defined( LOGGER_NOTES )
+#define NOTE() do {} while ( false )
+#else
+#define NOTE() do {                                             \
+        if ( Logger::enabled( Severity::Note ) )                \
+            Logger::log( __PRETTY_FUNCTION__, Severity::Note ); \
+    } while ( false )
+#endif
 
 #endif
@@ -34,6 +34,10 @@ const char *codeToString( Code code ) {
         return "Leave";
     case Code::CutRope:
         return "CutRope";
+    case Code::SpreadData:
+        return "SpreadData";
+    case Code::DataChunk:
+        return "DataChunk";
     case Code::Error:
         return "Error";
     case Code::Renegade:
@@ -46,6 +50,8 @@ const char *codeToString( Code code ) {
         return "ForceShutdown";
     case Code::ForceReset:
         return "ForceReset";
+    case Code::Traffic:
+        return "Traffic";
     default:
         return "<unknown code>";
     }
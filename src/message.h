@@ -13,7 +13,8 @@
 enum class MessageType : uint8_t {
     Data = 128,
     Control,
-    Output
+    Output,
+    Collective // values of reduce, read only by the reduction itself
 };
 
 // TAG (Output)
@@ -26,21 +27,22 @@ enum class Output {
 enum class Code {
     OK = 6,
     Refuse,
-    Enslave,// %D %S %D
+    Enslave,// %D %S %D (OK carries %D - the best wire format of the slave)
     Disconnect,
-    Peers, // %D
+    Peers, // %D [%D - wire format of the world]
     ConnectTo, // %D %S %S
     Join, // %D %S
-    DataLine, // %D %D
+    DataLine, // %D %D [%D - count of data channels]
     Grouped,
-    InitialData,
+    InitialData, // %L - length of the data which follow in DataChunk messages
     Run,
     Start,
     Done,
     PrepareToLeave,
     Leave,
     CutRope,
-
+    SpreadData, // like InitialData, passed down the tree of slaves as it comes
+    DataChunk, // next piece of the initial data
 
     Error = 32,
     Renegade,
@@ -49,10 +51,19 @@ enum class Code {
     Shutdown,
     ForceShutdown,
     ForceReset,
+    Traffic, // [ChannelTraffic] - counters of the channels of the running job
 };
 
 const char *codeToString( Code code );
 
+// counters of the channel from `rank` to `peer` of a running job
+struct ChannelTraffic {
+    int32_t rank;
+    int32_t peer;
+    int32_t channel; // ChannelType::Master or a data channel
+    brick::net::Traffic::Snapshot counters;
+};
+
 struct NetworkException : brick::net::NetException {
     NetworkException() :
         _what{ "internal network problem" }
@@ -7,6 +7,24 @@ std::string operator""_s( const char *string, size_t length ) {
     return {string, length};
 }
 
+std::string algorithmName( Algorithm algorithm ) {
+    switch ( algorithm ) {
+    case Algorithm::LoadShared:        return "load shared";
+    case Algorithm::LoadDedicated:     return "load dedicated";
+    case Algorithm::LoadIO:            return "load io";
+    case Algorithm::LongLoadShared:    return "long load shared";
+    case Algorithm::LongLoadDedicated: return "long load dedicated";
+    case Algorithm::LongLoadIO:        return "long load io";
+    case Algorithm::PingShared:        return "ping shared";
+    case Algorithm::PingDedicated:     return "ping dedicated";
+    case Algorithm::LongPingShared:    return "long ping shared";
+    case Algorithm::LongPingDedicated: return "long ping dedicated";
+    case Algorithm::Table:             return "table";
+    case Algorithm::None:
+    default:                           return "none";
+    }
+}
+
 struct View {
 
     View( void *ptr, size_t limit ) :
@@ -115,7 +133,19 @@ Meta::Meta( int argc, char **argv, bool ignoreFostFile ) :
     threads( 1 ),
     workLoad( 10 ),
     selection( 1 ),
+    coalesce( 0 ),
+    epoll( false ),
+    stealing( false ),
+    exhaustive( false ),
+    batch( 1 ),
+    window( 1 ),
+    sharded( false ),
+    fingerprints( false ),
+    compression( false ),
+    parallelSetup( false ),
+    tree( false ),
     detach( true ),
+    notes( true ),
     port( "41813" )
 {
 
@@ -125,6 +155,10 @@ Meta::Meta( int argc, char **argv, bool ignoreFostFile ) :
     BoolSwitch log;
     BoolSwitch sel;
     BoolSwitch p;
+    BoolSwitch co;
+    BoolSwitch ba;
+    BoolSwitch win;
+    BoolSwitch res;
 
     for ( int i = 1; i < argc; ++i ) {
 
@@ -153,6 +187,22 @@ Meta::Meta( int argc, char **argv, bool ignoreFostFile ) :
             port = argv[ i ];
             continue;
         }
+        if ( co ) {
+            coalesce = std::stoi( argv[ i ] );
+            continue;
+        }
+        if ( ba ) {
+            batch = std::stoi( argv[ i ] );
+            continue;
+        }
+        if ( win ) {
+            window = std::stoi( argv[ i ] );
+            continue;
+        }
+        if ( res ) {
+            results = argv[ i ];
+            continue;
+        }
 
         if ( argv[ i ] == "start"_s || argv[ i ] == "s"_s )
             command = Command::Start;
@@ -183,11 +233,17 @@ Meta::Meta( int argc, char **argv, bool ignoreFostFile ) :
             if ( algorithm == Algorithm::PingShared )
                 algorithm = Algorithm::PingDedicated;
         }
+        else if ( argv[ i ] == "io"_s ) {
+            if ( algorithm == Algorithm::LoadShared )
+                algorithm = Algorithm::LoadIO;
+        }
         else if ( argv[ i ] == "long"_s ) {
             if ( algorithm == Algorithm::LoadDedicated )
                 algorithm = Algorithm::LongLoadDedicated;
             if ( algorithm == Algorithm::LoadShared )
                 algorithm = Algorithm::LongLoadShared;
+            if ( algorithm == Algorithm::LoadIO )
+                algorithm = Algorithm::LongLoadIO;
             if ( algorithm == Algorithm::PingShared )
                 algorithm = Algorithm::LongPingShared;
             if ( algorithm == Algorithm::PingDedicated )
@@ -207,6 +263,32 @@ Meta::Meta( int argc, char **argv, bool ignoreFostFile ) :
             p.on();
         else if ( argv[ i ] == "--no-detach"_s )
             detach = false;
+        else if ( argv[ i ] == "--no-notes"_s )
+            notes = false;
+        else if ( argv[ i ] == "--coalesce"_s )
+            co.on();
+        else if ( argv[ i ] == "--epoll"_s )
+            epoll = true;
+        else if ( argv[ i ] == "--stealing"_s )
+            stealing = true;
+        else if ( argv[ i ] == "--exhaustive"_s )
+            exhaustive = true;
+        else if ( argv[ i ] == "--batch"_s )
+            ba.on();
+        else if ( argv[ i ] == "--window"_s )
+            win.on();
+        else if ( argv[ i ] == "--sharded"_s )
+            sharded = true;
+        else if ( argv[ i ] == "--fingerprints"_s )
+            fingerprints = true;
+        else if ( argv[ i ] == "--tree-compression"_s )
+            compression = true;
+        else if ( argv[ i ] == "--parallel-setup"_s )
+            parallelSetup = true;
+        else if ( argv[ i ] == "--tree"_s )
+            tree = true;
+        else if ( argv[ i ] == "--results"_s )
+            res.on();
     }
 
 }
@@ -218,9 +300,22 @@ Meta::Meta( char *block, size_t size ) {
         .get( threads )
         .get( workLoad )
         .get( selection )
+        .get( coalesce )
+        .get( epoll )
+        .get( stealing )
+        .get( exhaustive )
+        .get( batch )
+        .get( window )
+        .get( sharded )
+        .get( fingerprints )
+        .get( compression )
+        .get( parallelSetup )
+        .get( tree )
         .get( detach )
+        .get( notes )
         .get( port )
         .get( logFile )
+        .get( results )
         .get( hosts );
 }
 
@@ -242,8 +337,22 @@ MetaBlock Meta::block() const {
     size += sizeof( threads );
     size += sizeof( workLoad );
     size += sizeof( selection );
+    size += sizeof( coalesce );
+    size += sizeof( epoll );
+    size += sizeof( stealing );
+    size += sizeof( exhaustive );
+    size += sizeof( batch );
+    size += sizeof( window );
+    size += sizeof( sharded );
+    size += sizeof( fingerprints );
+    size += sizeof( compression );
+    size += sizeof( parallelSetup );
+    size += sizeof( tree );
+    size += sizeof( detach );
+    size += sizeof( notes );
     size += sizeof( size_t ) + port.size();
     size += sizeof( size_t ) + logFile.size();
+    size += sizeof( size_t ) + results.size();
     size += sizeof( size_t );
     for ( const auto &host : hosts )
         size += sizeof( size_t ) + host.size();
@@ -257,9 +366,22 @@ MetaBlock Meta::block() const {
         .set( threads )
         .set( workLoad )
         .set( selection )
+        .set( coalesce )
+        .set( epoll )
+        .set( stealing )
+        .set( exhaustive )
+        .set( batch )
+        .set( window )
+        .set( sharded )
+        .set( fingerprints )
+        .set( compression )
+        .set( parallelSetup )
+        .set( tree )
         .set( detach )
+        .set( notes )
         .set( port )
         .set( logFile )
+        .set( results )
         .set( hosts );
 
     return { std::move( block ), size };
@@ -21,8 +21,10 @@ enum class Algorithm {
     None,
     LoadShared,
     LoadDedicated,
+    LoadIO,
     LongLoadShared,
     LongLoadDedicated,
+    LongLoadIO,
     PingShared,
     PingDedicated,
     LongPingShared,
@@ -30,6 +32,8 @@ enum class Algorithm {
     Table,
 };
 
+std::string algorithmName( Algorithm );
+
 using MetaBlock = std::pair< std::unique_ptr< char[] >, size_t >;
 
 struct Meta {
@@ -38,9 +42,22 @@ struct Meta {
     int threads;
     int workLoad;
     int selection;
+    int coalesce;
+    bool epoll;
+    bool stealing;
+    bool exhaustive;
+    int batch;
+    int window;
+    bool sharded;
+    bool fingerprints;
+    bool compression;
+    bool parallelSetup;
+    bool tree;
     bool detach;
+    bool notes;
     std::string port;
     std::string logFile;
+    std::string results;
     std::vector< std::string > hosts;
 
     Meta( int, char **, bool = false );
@@ -89,6 +89,9 @@ struct Worker : BaseWorker< S, Package > {
         }
     }
 
+    // nothing to sum up, main turns down --exhaustive
+    static void report( Common< Package > & ) {}
+
     static bool isMaster( Common< Package > &common ) {
         return common.rank() == 0;
     }
@@ -114,21 +117,32 @@ struct LoadWorker : Worker< LoadWorker, Package > {
 
     void main() {
         while ( !this->quit() ) {
+            if ( this->sharded() ) {
+                this->shards().drain( this->id(), [this]( const Package &p, bool isnew ) {
+                    if ( isnew )
+                        this->push( p );
+                } );
+            }
             Package p;
             if ( this->pop( p ) ) {
                 successors( p, [this]( Package n ) {
                     process( n );
                 } );
             }
+            else
+                flushBatches();
         }
     }
 
     static void dispatcher( Common< Package > &common, const std::vector< LoadWorker > & ) {
         qa.reset( new QueueAccessor< Package >( common.queue() ) );
+        buffer.resize( common.batch() );
         int x = 0;
         while ( !common.quit() ) {
             MPI_Status status;
             ::sched_yield();
+            if ( common.sharded() )
+                common.shards().flush( common.shards().dispatcher() );
             std::lock_guard< std::mutex > _{ MPI_Mutex };
             int flag;
             MPI_Iprobe( MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status );
@@ -137,7 +151,7 @@ struct LoadWorker : Worker< LoadWorker, Package > {
                     common.done();
                     break;
                 }
-                processDispatch( common, status.MPI_SOURCE, status.MPI_TAG );
+                processDispatch( common, status );
             }
             else {
                 if ( ++x == 100 ) {
@@ -148,14 +162,27 @@ struct LoadWorker : Worker< LoadWorker, Package > {
         }
     }
 
-    static void processDispatch( Common< Package > &common, int from, int tag ) {
+    static void processDispatch( Common< Package > &common, MPI_Status &probed ) {
         static typename Set< Package >::ThreadData td;
 
-        Package p;
+        int bytes;
+        MPI_Get_count( &probed, MPI_BYTE, &bytes );
+        size_t count = bytes / sizeof( Package );
+        if ( count > buffer.size() )
+            throw std::runtime_error( "batch does not fit" );
+
         MPI_Status status;
-        MPI_Recv( &p, sizeof( p ), MPI_BYTE, from, tag, MPI_COMM_WORLD, &status );
-        if ( common.withTD( td ).insert( p ).isnew() )
-            qa->push( p );
+        MPI_Recv( buffer.data(), bytes, MPI_BYTE, probed.MPI_SOURCE, probed.MPI_TAG, MPI_COMM_WORLD, &status );
+        if ( common.sharded() ) {
+            for ( size_t i = 0; i < count; ++i )
+                common.shards().route( common.shards().dispatcher(), buffer[ i ] );
+            return;
+        }
+        common.withTD( td ).insertBatch( buffer.begin(), buffer.begin() + count,
+            []( const Package &p, typename Set< Package >::iterator it ) {
+                if ( it.isnew() )
+                    qa->push( p );
+            } );
     }
 
 private:
@@ -193,48 +220,55 @@ private:
         unsigned o = owner( p );
 
         if ( o == this->common().rank() ) {
-            if ( this->withTD().insert( p ).isnew() ) {
+            if ( this->sharded() )
+                this->shards().route( this->id(), p );
+            else if ( this->withTD().insert( p ).isnew() ) {
                 this->push( p );
             }
             return;
         }
+        if ( this->common().batch() > 1 )
+            return batch( o, p );
+
+        this->sent();
         std::lock_guard< std::mutex > _{ MPI_Mutex };
         MPI_Send( &p, sizeof( p ), MPI_BYTE, o, int( Tag::Data ), MPI_COMM_WORLD );
     }
-    static std::unique_ptr< QueueAccessor< Package > > qa;
-};
-template< typename Package >
-std::unique_ptr< QueueAccessor< Package > > LoadWorker< Package >::qa;
 
-struct Box {
-
-    Box() = default;
-    Box( const Box & ) = delete;
-    Box( Box && ) = delete;
+    void batch( unsigned o, Package &p ) {
+        if ( _batches.empty() )
+            _batches.resize( this->common().worldSize(),
+                             PackageBatch< Package >( this->common().batch() ) );
+        if ( _batches[ o ].push( p ) )
+            send( o );
+    }
 
-    void signal( int value ) {
-        std::lock_guard< std::mutex > _{ _mutex };
-        _ready = true;
-        _value = value;
-        _cv.notify_one();
+    void send( unsigned o ) {
+        PackageBatch< Package > &b = _batches[ o ];
+        {
+            std::lock_guard< std::mutex > _{ MPI_Mutex };
+            MPI_Send( b.data(), b.size() * sizeof( Package ), MPI_BYTE, o, int( Tag::Batch ), MPI_COMM_WORLD );
+        }
+        this->sent();
+        b.clear();
     }
 
-    int wait() {
-        std::unique_lock< std::mutex > guard{ _mutex };
-        _cv.wait( guard, [this] {
-             return _ready;
-        } );
-        _ready = false;
-        return _value;
+    void flushBatches() {
+        for ( unsigned o = 0; o < _batches.size(); ++o ) {
+            if ( !_batches[ o ].empty() )
+                send( o );
+        }
     }
 
-private:
-    bool _ready = false;
-    int _value;
-    std::mutex _mutex;
-    std::condition_variable _cv;
-};
+    std::vector< PackageBatch< Package > > _batches;
 
+    static std::unique_ptr< QueueAccessor< Package > > qa;
+    static std::vector< Package > buffer;
+};
+template< typename Package >
+std::unique_ptr< QueueAccessor< Package > > LoadWorker< Package >::qa;
+template< typename Package >
+std::vector< Package > LoadWorker< Package >::buffer;
 
 template< typename Package >
 struct PingWorker : Worker< PingWorker, Package > {
@@ -245,28 +279,39 @@ struct PingWorker : Worker< PingWorker, Package > {
         _generator{ std::random_device{}() },
         _distribution{ 0, common.worldSize() - 2 },
         _seed( std::random_device{}() ),
-        _box{ new Box }
+        _roundTrips{ new RoundTrips( common.window() ) }
     {}
 
     void push( int v ) {
-        _box->signal( v );
+        _roundTrips->respond( v );
     }
 
     void main() {
-        for ( int i = 0; i < this->common().workLoad(); ++i ) {
+        _roundTrips->run( this->common().workLoad(), [this]( int i ) {
             Package p;
             p.first = i + 13;
             p.second = this->id();
-
             {
                 std::lock_guard< std::mutex > _{ MPI_Mutex };
                 MPI_Send( &p, sizeof( p ), MPI_BYTE, owner( p ), int( Tag::Request ), MPI_COMM_WORLD );
             }
-            int response = _box->wait();
+            this->sent();
+            return p.first;
+        }, _latency );
+        this->latency( _latency );
+    }
 
-            if ( response != -p.first )
-                std::cout << response << " != " << -p.first << std::endl;
+    // round trips of all nodes
+    static void report( Common< Package > &common ) {
+        const Histogram &local = common.latency();
+        Histogram total;
+        {
+            std::lock_guard< std::mutex > _{ MPI_Mutex };
+            MPI_Reduce( local.counts, total.counts, Histogram::BUCKETS, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD );
+            MPI_Reduce( &local.max, &total.max, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD );
         }
+        if ( Worker::isMaster( common ) )
+            std::cout << "latency of selection " << common.selection() << ": " << total.summary() << std::endl;
     }
 
     static void dispatcher( Common< Package > &common, std::vector< PingWorker > &workers ) {
@@ -301,6 +346,7 @@ struct PingWorker : Worker< PingWorker, Package > {
         switch ( Tag( dispatchData.tag() ) ) {
         case Tag::Request:
             request( common.rank(), dispatchData, p );
+            common.sent();
             break;
         case Tag::Response:
             workers[ p.second ].push( p.first );
@@ -345,7 +391,8 @@ private:
     std::uniform_int_distribution<> _distribution;
     unsigned _seed;
 
-    std::unique_ptr< Box > _box;
+    std::unique_ptr< RoundTrips > _roundTrips;
+    Histogram _latency;
 };
 
 template<
@@ -353,7 +400,13 @@ template<
     typename Package
 >
 void startWorker( const Meta &meta ) {
-    Workers< W, Package > w( meta.threads, meta.workLoad, meta.selection );
+    Workers< W, Package > w( meta.threads, meta.workLoad, meta.selection,
+                             meta.stealing ? QueuePolicy::Stealing : QueuePolicy::Locked,
+                             false, meta.batch,
+                             meta.sharded ? SetPolicy::Sharded : SetPolicy::Shared, meta.window,
+                             meta.compression ? StoragePolicy::Tree : StoragePolicy::Exact );
+    if ( !meta.results.empty() )
+        w.results( meta.results, algorithmName( meta.algorithm ) );
     w.run();
 }
 
@@ -362,13 +415,26 @@ int main( int argc, char **argv ) {
 
     Meta meta( argc, argv );
 
+    // the workers never learn that the state space is done, so neither the
+    // states nor the fingerprints would get counted
+    if ( meta.exhaustive || meta.fingerprints ) {
+        int rank;
+        MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+        if ( rank == 0 )
+            std::cerr << "--exhaustive and --fingerprints need the daemons" << std::endl;
+        MPI_Finalize();
+        return 1;
+    }
+
     switch ( meta.algorithm ) {
     case Algorithm::LoadShared:
     case Algorithm::LoadDedicated:
+    case Algorithm::LoadIO:
         startWorker< LoadWorker, Package >( meta );
         break;
     case Algorithm::LongLoadDedicated:
     case Algorithm::LongLoadShared:
+    case Algorithm::LongLoadIO:
         startWorker< LoadWorker, LongPackage >( meta );
         break;
     case Algorithm::PingDedicated:
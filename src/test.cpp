@@ -1,7 +1,8 @@
 #include <brick-unittest.h>
 #include <brick-net.h>
 
-//#include "communicator.h"
+#include "communicator.h"
+#include "worker.hpp"
 
 //#include "client.h"
 //#include "daemon.h"
@@ -4,16 +4,33 @@
 #include <queue>
 #include <atomic>
 #include <mutex>
+#include <memory>
 #include <vector>
 #include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <thread>
+#include <iostream>
+#include <unordered_map>
 
 #include <brick-hashset.h>
+#include <brick-shmem.h>
+#include <brick-benchmark.h>
 
 enum class Tag {
     Data,
     Request,
     Response,
-    Done
+    Done,
+    Token,
+    Batch
 };
 
 struct Package {
@@ -34,45 +51,671 @@ struct Package {
 
 struct LongPackage : Package {
     char padding[10240];
+
+    // the padding goes over the wire and into TreeStore, it has to be defined
+    LongPackage() : padding() {}
 };
 
+using brick::hash::hash64_t;
 using brick::hash::hash128_t;
 
 template< typename Package >
 struct Hasher {
-    hash128_t hash( Package &p ) const {
+    hash128_t hash( const Package &p ) const {
         return { p.hash(), p.hash( ~0u ) };
     }
-    bool valid( Package & ) const {
+    bool valid( const Package & ) const {
         return true;
     }
-    bool equal( Package &lhs, Package &rhs ) const {
+    bool equal( const Package &lhs, const Package &rhs ) const {
         return
             lhs.first == rhs.first &&
             lhs.second == rhs.second;
     }
+
+    // first and second are what equal compares, they lie next to each other
+    static const void *key( const Package &p ) {
+        return &p.first;
+    }
+    static const size_t keySize = 2 * sizeof( int );
+
+    // whatever a derived package adds after result, see TreeStore
+    static const char *payload( const Package &p ) {
+        return reinterpret_cast< const char * >( &p ) + sizeof( ::Package );
+    }
+    static const size_t payloadSize = sizeof( Package ) - sizeof( ::Package );
+
+    // 64 bits which tell packages apart with high probability, see Visited
+    uint64_t fingerprint( const Package &p ) const {
+        return brick::hash::spooky( key( p ), keySize, 0, 0 ).first;
+    }
+};
+
+// a fingerprint is a hash already
+struct FingerprintHasher {
+    hash128_t hash( uint64_t f ) const {
+        return { f, f };
+    }
+    bool valid( uint64_t ) const {
+        return true;
+    }
+    bool equal( uint64_t lhs, uint64_t rhs ) const {
+        return lhs == rhs;
+    }
+};
+
+// what the visited set keeps of a package
+enum class StoragePolicy {
+    Exact,        // the whole package
+    Fingerprints, // 64 bits of its hash, see Visited
+    Tree          // chunks shared with other packages, see TreeStore
+};
+
+// the visited sets of a node, summed over the nodes in report
+struct Storage {
+    uint64_t states = 0;
+    uint64_t bytes = 0;   // of the tables
+    double omission = 0;  // the chance that a state was taken for another one
+
+    Storage operator+( const Storage &o ) const {
+        Storage s;
+        s.states = states + o.states;
+        s.bytes = bytes + o.bytes;
+        s.omission = omission + o.omission;
+        return s;
+    }
+};
+
+/*
+ * Items of a fixed size interned concurrently, equal items get the same
+ * 32-bit id. The items live in segments which never move and the ids are
+ * kept in a set of group cells which hashes and compares them by what
+ * they stand for. Two threads may append an equal item at once, then the
+ * one which loses the race to the set leaves its copy unused.
+ */
+template< typename Node >
+struct Interned {
+    using Id = uint32_t;
+
+    struct Hasher {
+        Interned *_interned;
+
+        Hasher( Interned *i = nullptr ) :
+            _interned( i )
+        {}
+
+        hash128_t hash( const Node *n ) const {
+            return brick::hash::spooky( n, sizeof( Node ), 0, 0 );
+        }
+        hash128_t hash( Id id ) const {
+            return hash( &_interned->at( id ) );
+        }
+        bool valid( Id ) const {
+            return true;
+        }
+        bool equal( Id lhs, const Node *rhs ) const {
+            return std::memcmp( &_interned->at( lhs ), rhs, sizeof( Node ) ) == 0;
+        }
+        bool equal( Id lhs, Id rhs ) const {
+            return lhs == rhs || equal( lhs, &_interned->at( rhs ) );
+        }
+    };
+
+    using Ids = brick::hashset::GroupConcurrent< Id, Hasher >;
+    using ThreadData = typename Ids::ThreadData;
+
+    Interned() :
+        _segments( new std::atomic< Node * >[ segments ]() ),
+        _next( 0 ),
+        _ids( Hasher( this ) )
+    {
+        _ids.setSize( 1024 );
+    }
+    ~Interned() {
+        for ( size_t i = 0; i < segments; ++i )
+            delete[] _segments[ i ].load( std::memory_order_relaxed );
+    }
+
+    Interned( const Interned & ) = delete;
+    Interned &operator=( const Interned & ) = delete;
+
+    // the id of an item equal to `n`, which is appended unless there is one
+    Id intern( const Node &n, ThreadData &td ) {
+        auto ids = _ids.withTD( td );
+        hash64_t h = Hasher().hash( &n ).first;
+        auto found = ids.findHinted( &n, h );
+        if ( found.valid() )
+            return *found;
+        return *ids.insertHinted( append( n ), h );
+    }
+
+    const Node &at( Id id ) const {
+        return _segments[ id >> segmentBits ].load( std::memory_order_acquire )[ id & mask ];
+    }
+
+    // the items appended and the set of their ids
+    size_t bytes() {
+        return _next.load( std::memory_order_relaxed ) * sizeof( Node ) + _ids.size() * Ids::slotBytes;
+    }
+
+private:
+    static const unsigned segmentBits = 16;
+    static const size_t segmentSize = size_t( 1 ) << segmentBits;
+    static const size_t segments = size_t( 1 ) << ( 32 - segmentBits );
+    static const size_t mask = segmentSize - 1;
+
+    // the set publishes the id with release after the item is written
+    Id append( const Node &n ) {
+        uint64_t id = _next.fetch_add( 1, std::memory_order_relaxed );
+        if ( id >> 32 )
+            throw std::length_error( "out of 32-bit ids for interned items" );
+        std::atomic< Node * > &segment = _segments[ id >> segmentBits ];
+        Node *nodes = segment.load( std::memory_order_acquire );
+        if ( !nodes ) {
+            std::unique_ptr< Node[] > fresh( new Node[ segmentSize ] );
+            if ( segment.compare_exchange_strong( nodes, fresh.get() ) )
+                nodes = fresh.release();
+        }
+        nodes[ id & mask ] = n;
+        return Id( id );
+    }
+
+    std::unique_ptr< std::atomic< Node * >[] > _segments;
+    std::atomic< uint64_t > _next;
+    Ids _ids;
 };
 
+/*
+ * Tree compression: a package is cut into chunks, each chunk is interned
+ * and so are pairs of ids, level by level up to a single root. Neighbouring
+ * states share all nodes but those above the chunks in which they differ,
+ * so a state of a LongPackage costs a few pairs instead of 10 KB. A package
+ * is new when its root is; a root may also be an inner node of another
+ * package, which is why the roots have a set of their own. The chunks
+ * cover the key of Hasher followed by the payload; result follows from
+ * first and second and is left out, so the store counts what Exact does.
+ */
 template< typename Package >
-using Set = brick::hashset::FastConcurrent< Package, Hasher< Package > >;
+struct TreeStore {
+    using Id = uint32_t;
+
+    using Hasher = ::Hasher< Package >;
+
+    static const size_t size = Hasher::keySize + Hasher::payloadSize; // bytes
+    static const size_t chunk = size < 256 ? size : 256;
+    static const size_t chunks = ( size + chunk - 1 ) / chunk;
+
+    struct Leaf {
+        char bytes[ chunk ];
+    };
+    struct Pair {
+        Id left;
+        Id right;
+    };
+
+    // ids come in order, a multiplication spreads them over the control bytes
+    struct RootHasher {
+        hash128_t hash( Id id ) const {
+            uint64_t h = id * 0x9e3779b97f4a7c15ull;
+            return { h, h };
+        }
+        bool valid( Id ) const {
+            return true;
+        }
+        bool equal( Id lhs, Id rhs ) const {
+            return lhs == rhs;
+        }
+    };
+    using Roots = brick::hashset::GroupConcurrent< Id, RootHasher >;
+
+    struct ThreadData {
+        typename Interned< Leaf >::ThreadData leaves;
+        typename Interned< Pair >::ThreadData pairs;
+        typename Roots::ThreadData roots;
+    };
+
+    TreeStore() {
+        _roots.setSize( 1024 );
+    }
+
+    bool insert( const Package &p, ThreadData &td ) {
+        Id level[ chunks ];
+        for ( size_t i = 0; i < chunks; ++i ) {
+            Leaf leaf;
+            size_t length = i + 1 < chunks ? chunk : size - i * chunk;
+            read( p, i * chunk, length, leaf.bytes );
+            std::memset( leaf.bytes + length, 0, chunk - length );
+            level[ i ] = _leaves.intern( leaf, td.leaves );
+        }
+        // an odd node goes up as it is, packages have the same shape anyway
+        for ( size_t n = chunks; n > 1; n = ( n + 1 ) / 2 ) {
+            for ( size_t i = 0; i < n; i += 2 )
+                level[ i / 2 ] = i + 1 < n ? _pairs.intern( Pair{ level[ i ], level[ i + 1 ] }, td.pairs )
+                                           : level[ i ];
+        }
+        return _roots.withTD( td.roots ).insert( level[ 0 ] ).isnew();
+    }
+
+    // walks the roots, nobody may insert meanwhile
+    Storage stored() {
+        Storage s;
+        size_t size = _roots.size();
+        for ( size_t i = 0; i < size; ++i )
+            s.states += _roots.valid( i );
+        s.bytes = _leaves.bytes() + _pairs.bytes() + size * Roots::slotBytes;
+        return s;
+    }
+
+private:
+    // bytes [from, from + length) of the key and the payload put together
+    static void read( const Package &p, size_t from, size_t length, char *out ) {
+        const char *key = static_cast< const char * >( Hasher::key( p ) );
+        size_t head = from < Hasher::keySize ? std::min( length, Hasher::keySize - from ) : 0;
+        std::memcpy( out, key + from, head );
+        std::memcpy( out + head, Hasher::payload( p ) + from + head - Hasher::keySize, length - head );
+    }
+
+    Interned< Leaf > _leaves;
+    Interned< Pair > _pairs;
+    Roots _roots;
+};
+
+/*
+ * The packages seen so far. Exact storage keeps whole packages. With
+ * fingerprints only 64 bits of a hash of each package are kept (hash
+ * compaction) in a table of group cells, whose control bytes mark the empty
+ * slots, so a state costs 9 bytes whatever the size of the package. Two
+ * packages with the same fingerprint are taken for one and the later one is
+ * never explored; for n states that happens with probability about n^2/2^65.
+ * Tree storage is exact again, but shares what the packages have in common.
+ */
+template< typename Package, typename Exact, typename Fingerprints >
+struct Visited {
+    using Hasher = ::Hasher< Package >;
+
+    struct ThreadData {
+        typename Exact::ThreadData exact;
+        typename Fingerprints::ThreadData fingerprints;
+        typename TreeStore< Package >::ThreadData tree;
+    };
+
+    // callers only learn whether the package is new
+    struct iterator {
+        bool _new;
+        bool isnew() const {
+            return _new;
+        }
+    };
+
+    struct WithTD {
+        WithTD( Visited &v, ThreadData &td ) :
+            _v( v ),
+            _td( td )
+        {}
+
+        iterator insert( const Package &p ) {
+            switch ( _v._storage ) {
+            case StoragePolicy::Exact:
+                return { _v._exact.withTD( _td.exact ).insert( p ).isnew() };
+            case StoragePolicy::Tree:
+                return { _v._tree->insert( p, _td.tree ) };
+            default:
+                auto fingerprint = Hasher().fingerprint( p );
+                return { _v._fingerprints.withTD( _td.fingerprints ).insert( fingerprint ).isnew() };
+            }
+        }
+
+        // yield( package, iterator ) in order, see _ConcurrentHashSet::insertBatch
+        template< typename It, typename Yield >
+        void insertBatch( It begin, It end, Yield yield ) {
+            if ( _v._storage == StoragePolicy::Exact ) {
+                _v._exact.withTD( _td.exact ).insertBatch( begin, end,
+                    [&]( const Package &p, typename Exact::iterator it ) {
+                        yield( p, iterator{ it.isnew() } );
+                    } );
+                return;
+            }
+            if ( _v._storage == StoragePolicy::Tree ) {
+                for ( ; begin != end; ++begin )
+                    yield( *begin, insert( *begin ) );
+                return;
+            }
+            // the keys of a window are hashed together on vector lanes
+            const void *keys[ window ];
+            hash128_t hashes[ window ];
+            uint64_t prints[ window ];
+            while ( begin != end ) {
+                It from = begin;
+                size_t n = 0;
+                for ( ; begin != end && n < window; ++begin, ++n )
+                    keys[ n ] = Hasher::key( *begin );
+                brick::hash::spooky( keys, n, Hasher::keySize, 0, 0, hashes );
+                for ( size_t i = 0; i < n; ++i )
+                    prints[ i ] = hashes[ i ].first;
+                _v._fingerprints.withTD( _td.fingerprints ).insertBatch( prints, prints + n,
+                    [&]( uint64_t, typename Fingerprints::iterator it ) {
+                        yield( *from, iterator{ it.isnew() } );
+                        ++from;
+                    } );
+            }
+        }
+
+    private:
+        static const size_t window = 16;
+
+        Visited &_v;
+        ThreadData &_td;
+    };
+
+    Visited( StoragePolicy storage = StoragePolicy::Exact ) :
+        _storage( storage )
+    {
+        if ( storage == StoragePolicy::Tree )
+            _tree.reset( new TreeStore< Package > );
+    }
+
+    StoragePolicy storage() const {
+        return _storage;
+    }
+
+    // only the table in use gets the size, the tree sizes its own
+    void setSize( size_t s ) {
+        if ( _storage == StoragePolicy::Exact )
+            _exact.setSize( s );
+        if ( _storage == StoragePolicy::Fingerprints )
+            _fingerprints.setSize( s );
+    }
+
+    WithTD withTD( ThreadData &td ) {
+        return WithTD( *this, td );
+    }
+    // for a single thread
+    iterator insert( const Package &p ) {
+        return withTD( _global ).insert( p );
+    }
+
+    // walks the table, nobody may insert meanwhile
+    Storage stored() {
+        switch ( _storage ) {
+        case StoragePolicy::Exact:
+            return count( _exact, false );
+        case StoragePolicy::Tree:
+            return _tree->stored();
+        default:
+            return count( _fingerprints, true );
+        }
+    }
+
+private:
+    template< typename S >
+    static Storage count( S &set, bool lossy ) {
+        Storage s;
+        size_t size = set.size();
+        for ( size_t i = 0; i < size; ++i )
+            s.states += set.valid( i );
+        s.bytes = size * S::slotBytes;
+        if ( lossy )
+            s.omission = std::ldexp( double( s.states ) * double( s.states ), -65 );
+        return s;
+    }
+
+    StoragePolicy _storage;
+    Exact _exact;
+    Fingerprints _fingerprints;
+    std::unique_ptr< TreeStore< Package > > _tree; // only when used, it is not small
+    ThreadData _global;
+};
+
+// the cell decides the layout of the set; GroupAtomicCell probes 16 slots at once
+template< typename Package,
+          template< typename, typename > class Cell = brick::hashset::FastAtomicCell >
+using Set = Visited< Package,
+                     brick::hashset::_ConcurrentHashSet< Cell< Package, Hasher< Package > > >,
+                     brick::hashset::GroupConcurrent< uint64_t, FingerprintHasher > >;
 
 template< typename Package >
 using Chunk = std::queue< Package >;
 
+enum class SetPolicy {
+    Shared, // one concurrent set for all threads of a node
+    Sharded // each worker owns a part of the set, see Shards
+};
+
+// The set of a node split among its workers. A package belongs to the worker
+// picked by the second half of its hash, the first half selects the cell
+// within the shard. Other threads pass the package to the owner through an
+// SPSC ring; thread number `workers` is the dispatcher.
 template< typename Package >
-using Queue = brick::shmem::LockedQueue< Chunk< Package > >;
+struct Shards {
+    using Shard = Visited< Package,
+                           brick::hashset::Fast< Package, Hasher< Package > >,
+                           brick::hashset::Group< uint64_t, FingerprintHasher > >;
+    using Ring = brick::shmem::SpscRing< Package >;
+
+    Shards( int workers, StoragePolicy storage = StoragePolicy::Exact ) :
+        _workers( workers ),
+        _overflow( ( workers + 1 ) * workers )
+    {
+        size_t capacity = std::max( size_t( 16 ), size_t( 64 * 1024 ) / sizeof( Package ) );
+        for ( int i = 0; i < ( workers + 1 ) * workers; ++i )
+            _rings.emplace_back( new Ring( capacity ) );
+        for ( int i = 0; i < workers; ++i ) {
+            _shards.emplace_back( new Shard( storage ) );
+            _shards.back()->setSize( 1024 );
+        }
+    }
+
+    int dispatcher() const {
+        return _workers;
+    }
+    int owner( const Package &p ) const {
+        return Hasher< Package >().hash( p ).second % _workers;
+    }
+
+    // packages which do not fit into the ring wait in a queue of the sender
+    void route( int from, const Package &p ) {
+        int to = owner( p );
+        Chunk< Package > &overflow = _overflow[ index( from, to ) ];
+        if ( !overflow.empty() || !ring( from, to ).push( p ) )
+            overflow.push( p );
+    }
+
+    void flush( int from ) {
+        for ( int to = 0; to < _workers; ++to ) {
+            Chunk< Package > &overflow = _overflow[ index( from, to ) ];
+            while ( !overflow.empty() && ring( from, to ).push( overflow.front() ) )
+                overflow.pop();
+        }
+    }
+
+    // inserts packages routed to the worker; yield( package, isnew )
+    template< typename Yield >
+    void drain( int to, Yield yield ) {
+        flush( to );
+        Package p;
+        for ( int from = 0; from <= _workers; ++from ) {
+            Ring &r = ring( from, to );
+            while ( r.pop( p ) )
+                yield( p, _shards[ to ]->insert( p ).isnew() );
+        }
+    }
+
+    // a collision may hide a state only within its shard
+    Storage stored() {
+        Storage s;
+        for ( auto &shard : _shards )
+            s = s + shard->stored();
+        return s;
+    }
+
+private:
+    size_t index( int from, int to ) const {
+        return from * _workers + to;
+    }
+    Ring &ring( int from, int to ) {
+        return *_rings[ index( from, to ) ];
+    }
+
+    int _workers;
+    std::vector< std::unique_ptr< Shard > > _shards;
+    std::vector< std::unique_ptr< Ring > > _rings;
+    std::vector< Chunk< Package > > _overflow; // touched by the sender only
+};
+
+// packages for one destination, stored contiguously so that they can go
+// out as a single segment of a Tag::Batch message
+template< typename Package >
+struct PackageBatch {
+
+    PackageBatch( size_t capacity = 1 ) :
+        _capacity( std::max( capacity, size_t( 1 ) ) )
+    {
+        _packages.reserve( _capacity );
+    }
+
+    // returns true once the batch is full
+    bool push( const Package &p ) {
+        _packages.push_back( p );
+        return full();
+    }
+    bool full() const {
+        return _packages.size() >= _capacity;
+    }
+    bool empty() const {
+        return _packages.empty();
+    }
+    size_t size() const {
+        return _packages.size();
+    }
+    size_t capacity() const {
+        return _capacity;
+    }
+    // keeps the storage, the batch never reallocates
+    void clear() {
+        _packages.clear();
+    }
+    std::vector< Package > &packages() {
+        return _packages;
+    }
+    Package *data() {
+        return _packages.data();
+    }
+
+private:
+    size_t _capacity;
+    std::vector< Package > _packages;
+};
+
+enum class QueuePolicy {
+    Locked,  // all chunks go through one locked queue
+    Stealing // each accessor has its own deque, idle ones steal
+};
+
+template< typename Package >
+struct Queue {
+    using Chunk = Chunk< Package >;
+    using Deque = brick::shmem::StealingDeque< Chunk * >;
+    enum { MaxAccessors = 256 };
+
+    Queue( QueuePolicy policy = QueuePolicy::Locked ) :
+        _policy( policy ),
+        _attached{ 0 }
+    {
+        for ( auto &d : _deques )
+            d.store( nullptr, std::memory_order_relaxed );
+    }
+    Queue( const Queue & ) = delete;
+    Queue &operator=( const Queue & ) = delete;
+
+    ~Queue() {
+        for ( auto &d : _deques ) {
+            Deque *deque = d.load( std::memory_order_relaxed );
+            if ( !deque )
+                continue;
+            Chunk *chunk;
+            while ( deque->pop( chunk ) )
+                delete chunk;
+            delete deque;
+        }
+    }
+
+    QueuePolicy policy() const {
+        return _policy;
+    }
+
+    // approximate, chunks may be taken or added meanwhile
+    bool empty() const {
+        if ( !_shared.empty() )
+            return false;
+        unsigned n = std::min( _attached.load( std::memory_order_relaxed ), unsigned( MaxAccessors ) );
+        for ( unsigned i = 0; i < n; ++i ) {
+            Deque *deque = _deques[ i ].load( std::memory_order_acquire );
+            if ( deque && !deque->empty() )
+                return false;
+        }
+        return true;
+    }
+
+    // the shared queue; also holds initial chunks in stealing mode
+    void push( Chunk &&chunk ) {
+        _shared.push( std::move( chunk ) );
+    }
+    Chunk pop() {
+        return _shared.pop();
+    }
+
+    // returns a deque owned by the caller or nullptr in locked mode
+    Deque *attach() {
+        if ( _policy == QueuePolicy::Locked )
+            return nullptr;
+        unsigned i = _attached++;
+        if ( i >= MaxAccessors )
+            throw std::runtime_error( "too many queue accessors" );
+        Deque *deque = new Deque;
+        _deques[ i ].store( deque, std::memory_order_release );
+        return deque;
+    }
+
+    // takes a chunk from the shared queue or from the deque of another accessor
+    bool steal( Chunk &chunk, const Deque *self, unsigned start ) {
+        chunk = _shared.pop();
+        if ( !chunk.empty() )
+            return true;
+
+        unsigned n = std::min( _attached.load( std::memory_order_relaxed ), unsigned( MaxAccessors ) );
+        for ( unsigned k = 0; k < n; ++k ) {
+            Deque *victim = _deques[ ( start + k ) % n ].load( std::memory_order_acquire );
+            Chunk *stolen;
+            if ( victim && victim != self && victim->steal( stolen ) ) {
+                chunk = std::move( *stolen );
+                delete stolen;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    QueuePolicy _policy;
+    brick::shmem::LockedQueue< Chunk > _shared;
+    std::atomic< unsigned > _attached;
+    std::atomic< Deque * > _deques[ MaxAccessors ];
+};
 
 template< typename Package >
 struct QueueAccessor {
     using Chunk = Chunk< Package >;
+    using Deque = typename Queue< Package >::Deque;
 
     QueueAccessor( Queue< Package > & q ) :
-        _q( q )
+        _q( q ),
+        _own( q.attach() ),
+        _random( reinterpret_cast< uintptr_t >( this ) )
     {}
 
     bool empty() {
         if ( _incoming.empty() )
-            _incoming = _q.pop();
+            take();
         if ( _incoming.empty() )
             flush();
         return _incoming.empty();
@@ -81,7 +724,10 @@ struct QueueAccessor {
         if ( !_outgoing.empty() ) {
             Chunk tmp;
             std::swap( tmp, _outgoing );
-            _q.push( std::move( tmp ) );
+            if ( _own )
+                _own->push( new Chunk( std::move( tmp ) ) );
+            else
+                _q.push( std::move( tmp ) );
 
             if ( _chunkSize < _maxChunkSize )
                 _chunkSize = std::min( 2 * _chunkSize, _maxChunkSize );
@@ -103,23 +749,292 @@ struct QueueAccessor {
     }
 
 private:
+    void take() {
+        if ( !_own ) {
+            _incoming = _q.pop();
+            return;
+        }
+        Chunk *chunk;
+        if ( _own->pop( chunk ) ) {
+            _incoming = std::move( *chunk );
+            delete chunk;
+            return;
+        }
+        _q.steal( _incoming, _own, _random() );
+    }
+
     const unsigned _maxChunkSize = 64;
     unsigned _chunkSize = 2;
 
     Queue< Package > &_q;
+    Deque *_own;
+    std::minstd_rand _random;
     Chunk _outgoing;
     Chunk _incoming;
 };
 
+// Safra's termination detection. The token travels around the ring of
+// nodes and sums the sent and received data messages; a node which
+// received a message since the token last left it turns the token black,
+// which forces another round. Only the dispatcher touches the token.
+struct Termination {
+    struct Token {
+        int64_t count;
+        bool black;
+    };
+
+    enum class Step {
+        Wait,      // the token is elsewhere or this node is active
+        Forward,   // pass the token to the next node
+        Terminated
+    };
+
+    Termination() :
+        _count{ 0 },
+        _black{ false },
+        _pending{ 0 },
+        _initiator( false ),
+        _started( false ),
+        _holding( false ),
+        _token{ 0, false }
+    {}
+
+    void sent() {
+        ++_count;
+    }
+    // the message is work, it has to be followed by finished()
+    void received() {
+        ++_pending;
+        _black = true;
+        --_count;
+    }
+    void spawned() {
+        ++_pending;
+    }
+    void finished() {
+        --_pending;
+    }
+    bool passive() const {
+        return _pending == 0;
+    }
+
+    void initiate() {
+        _initiator = true;
+        _holding = true;
+    }
+    void receive( Token token ) {
+        _token = token;
+        _holding = true;
+    }
+    bool holding() const {
+        return _holding;
+    }
+
+    Step step( Token &out ) {
+        if ( !_holding || !passive() )
+            return Step::Wait;
+
+        // the count has to be read before the colour, see received()
+        if ( _initiator ) {
+            if ( _started ) {
+                int64_t count = _token.count + _count;
+                bool black = _token.black || _black.exchange( false );
+                if ( !black && count == 0 )
+                    return Step::Terminated;
+            }
+            _started = true;
+            _black = false;
+            out = Token{ 0, false };
+        }
+        else {
+            out.count = _token.count + _count;
+            out.black = _token.black || _black.exchange( false );
+        }
+        _holding = false;
+        return Step::Forward;
+    }
+
+private:
+    std::atomic< int64_t > _count; // sent minus received
+    std::atomic< bool > _black;
+    std::atomic< int64_t > _pending; // packages not processed yet
+    bool _initiator;
+    bool _started;
+    bool _holding;
+    Token _token;
+};
+
+// wall time of the phases of Workers::run in seconds
+struct Phases {
+    using Clock = std::chrono::steady_clock;
+
+    double initials = 0;
+    std::vector< double > mains; // one per worker thread
+    double run = 0;              // from the start of the workers until all finish
+    double dispatcher = 0;
+    double notify = 0;
+    double total = 0;
+
+    static Clock::time_point now() {
+        return Clock::now();
+    }
+    static double since( Clock::time_point start ) {
+        return std::chrono::duration< double >( now() - start ).count();
+    }
+};
+
+// latencies in nanoseconds, bucketed in the manner of HdrHistogram: each
+// power of two is split into SUB linear buckets, so a value is known with
+// relative error below 1/SUB; the counts merge by addition
+struct Histogram {
+    enum {
+        SUB_BITS = 5,
+        SUB = 1 << SUB_BITS,
+        OCTAVES = 40, // up to 2^45 ns
+        BUCKETS = ( OCTAVES + 1 ) * SUB
+    };
+
+    uint64_t counts[ BUCKETS ] = {};
+    uint64_t max = 0;
+
+    void record( uint64_t value ) {
+        ++counts[ bucket( value ) ];
+        max = std::max( max, value );
+    }
+    void record( Phases::Clock::time_point start ) {
+        record( std::chrono::duration_cast< std::chrono::nanoseconds >( Phases::now() - start ).count() );
+    }
+
+    void merge( const Histogram &other ) {
+        for ( int b = 0; b < BUCKETS; ++b )
+            counts[ b ] += other.counts[ b ];
+        max = std::max( max, other.max );
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for ( uint64_t c : counts )
+            total += c;
+        return total;
+    }
+
+    // the highest value of the bucket holding the quantile `q`
+    uint64_t percentile( double q ) const {
+        uint64_t total = count();
+        if ( !total )
+            return 0;
+        uint64_t rank = std::max( uint64_t( 1 ), uint64_t( std::ceil( q * total ) ) );
+        uint64_t seen = 0;
+        for ( int b = 0; b < BUCKETS; ++b ) {
+            seen += counts[ b ];
+            if ( seen >= rank )
+                return std::min( upper( b ), max );
+        }
+        return max;
+    }
+
+    // p50/p99/p99.9/max in microseconds
+    std::string summary() const {
+        auto us = []( uint64_t ns ) {
+            std::ostringstream s;
+            s << std::fixed << std::setprecision( 1 ) << ns / 1000.0 << " us";
+            return s.str();
+        };
+        return "p50 " + us( percentile( 0.5 ) ) +
+               ", p99 " + us( percentile( 0.99 ) ) +
+               ", p99.9 " + us( percentile( 0.999 ) ) +
+               ", max " + us( max ) +
+               " of " + std::to_string( count() ) + " round trips";
+    }
+
+    static int bucket( uint64_t value ) {
+        if ( value < SUB )
+            return value;
+        int msb = 63 - __builtin_clzll( value );
+        int shift = msb - SUB_BITS;
+        int b = ( shift + 1 ) * SUB + int( ( value >> shift ) - SUB );
+        return std::min( b, BUCKETS - 1 );
+    }
+    static uint64_t upper( int b ) {
+        if ( b < SUB )
+            return b;
+        int shift = b / SUB - 1;
+        uint64_t base = SUB + b % SUB;
+        return ( ( base + 1 ) << shift ) - 1;
+    }
+};
+
+// a ping worker keeps up to `window` requests in flight; the dispatcher
+// hands the responses over through a ring the worker waits on, see
+// brick::shmem::ParkingRing
+struct RoundTrips {
+    using Ring = brick::shmem::ParkingRing< int >;
+
+    RoundTrips( int window ) :
+        _window( window ),
+        _responses( new Ring( window ) )
+    {}
+
+    // dispatcher only
+    void respond( int value ) {
+        while ( !_responses->push( value ) )
+            std::this_thread::yield();
+    }
+
+    // ask( i ) sends the i-th request and returns its value, whose negation
+    // comes back, or zero if the request could not be sent
+    template< typename Ask >
+    void run( int count, Ask ask, Histogram &latency ) {
+        std::unordered_map< int, Phases::Clock::time_point > inflight;
+        int next = 0, done = 0;
+        auto fill = [&] {
+            while ( next < count && int( inflight.size() ) < _window ) {
+                auto start = Phases::now();
+                if ( int request = ask( next++ ) )
+                    inflight[ request ] = start;
+                else
+                    ++done;
+            }
+        };
+
+        fill();
+        while ( done < count ) {
+            int response;
+            _responses->wait( response );
+            ++done;
+            auto request = inflight.find( -response );
+            if ( request == inflight.end() )
+                std::cout << "unexpected response " << response << std::endl;
+            else {
+                latency.record( request->second );
+                inflight.erase( request );
+            }
+            fill();
+        }
+    }
+
+private:
+    int _window;
+    std::unique_ptr< Ring > _responses;
+};
+
 template< typename Package >
 struct Common {
-    Common( int workLoad, int selection, int rank, int worldSize ) :
+    Common( int workLoad, int selection, int rank, int worldSize,
+            QueuePolicy policy = QueuePolicy::Locked, bool exhaustive = false,
+            int batch = 1, int window = 1, StoragePolicy storage = StoragePolicy::Exact ) :
         _workLoad{ workLoad },
         _selection{ selection },
         _rank{ rank },
         _worldSize{ worldSize },
+        _exhaustive{ exhaustive },
+        _batch{ std::max( batch, 1 ) },
+        _window{ std::max( window, 1 ) },
+        _queue( policy ),
         _done{ false },
-        _processed{ 0u }
+        _processed{ 0u },
+        _sent{ 0u },
+        _set( storage )
     {
         _set.setSize( 1024 );
     }
@@ -127,6 +1042,9 @@ struct Common {
     Queue< Package > &queue() {
         return _queue;
     }
+    Termination &termination() {
+        return _termination;
+    }
 
     bool quit() const {
         return _done;
@@ -140,11 +1058,44 @@ struct Common {
     unsigned processed() const {
         return _processed;
     }
+    // a message with packages left this node
+    void sent() {
+        _sent.fetch_add( 1, std::memory_order_relaxed );
+    }
+    uint64_t messages() const {
+        return _sent.load( std::memory_order_relaxed );
+    }
+    // workers add their round trips once they finish
+    void latency( const Histogram &h ) {
+        std::lock_guard< std::mutex > _{ _latencyMutex };
+        _latency.merge( h );
+    }
+    const Histogram &latency() const {
+        return _latency;
+    }
 
     typename Set< Package >::WithTD withTD( typename Set< Package >::ThreadData &td ) {
         return _set.withTD( td );
     }
 
+    // splits the set among the workers, see Shards
+    void shard( int workers ) {
+        _shards.reset( new Shards< Package >( workers, _set.storage() ) );
+    }
+    bool sharded() const {
+        return bool( _shards );
+    }
+    Shards< Package > &shards() {
+        return *_shards;
+    }
+    StoragePolicy storage() const {
+        return _set.storage();
+    }
+    // what the node keeps once the workers are done
+    Storage stored() {
+        return sharded() ? _shards->stored() : _set.stored();
+    }
+
     int F() const {
         return F( _selection );
     }
@@ -161,6 +1112,18 @@ struct Common {
     int worldSize() const {
         return _worldSize;
     }
+    // do not stop at the goal, explore everything
+    bool exhaustive() const {
+        return _exhaustive;
+    }
+    // packages per remote message, 1 means no batching
+    int batch() const {
+        return _batch;
+    }
+    // requests a ping worker keeps in flight
+    int window() const {
+        return _window;
+    }
 private:
 
     static int F( int n ) {
@@ -175,10 +1138,18 @@ private:
     int _selection;
     int _rank;
     int _worldSize;
+    bool _exhaustive;
+    int _batch;
+    int _window;
     Queue< Package > _queue;
+    Termination _termination;
     std::atomic< bool > _done;
     std::atomic< unsigned > _processed;
+    std::atomic< uint64_t > _sent;
+    std::mutex _latencyMutex;
+    Histogram _latency;
     Set< Package > _set;
+    std::unique_ptr< Shards< Package > > _shards;
 };
 
 template< template< typename > class S, typename Package >
@@ -199,22 +1170,34 @@ struct BaseWorker {
         return _common.workLoad();
     }
 
+    // workers which need the set of a node split may override it
+    static SetPolicy sets( SetPolicy requested ) {
+        return requested;
+    }
+
     void start() {
         _handle = std::async( std::launch::async, [this] {
+            auto start = Phases::now();
             try {
                 this->self().main();
             } catch ( const std::exception &e ) {
                 std::cerr << "exception: " << e.what() << std::endl;
             }
+            _elapsed = Phases::since( start );
         } );
     }
     void wait() {
         _handle.get();
     }
+    // seconds spent in main
+    double elapsed() const {
+        return _elapsed;
+    }
 
     // void notifyAll( Common & )
     // bool isMaster()
     // void dispatcher( Common &, std::vector< Self > & )
+    // void report( Common & )
 protected:
     void push( Package p ) {
         _qa.push( p );
@@ -243,6 +1226,21 @@ protected:
     void progress() {
         _common.progress();
     }
+    void sent() {
+        _common.sent();
+    }
+    void latency( const Histogram &h ) {
+        _common.latency( h );
+    }
+    Termination &termination() {
+        return _common.termination();
+    }
+    bool sharded() const {
+        return _common.sharded();
+    }
+    Shards< Package > &shards() {
+        return _common.shards();
+    }
 private:
     Self &self() {
         return *static_cast< Self * >( this );
@@ -253,6 +1251,7 @@ private:
     typename Set< Package >::ThreadData _td;
     QueueAccessor< Package > _qa;
     std::future< void > _handle;
+    double _elapsed = 0;
 };
 
 template< template< typename > class WT, typename Package >
@@ -260,9 +1259,15 @@ struct Workers {
 
     using W = WT< Package >;
 
-    Workers( int workers, int workLoad, int selection ) :
-        _common{ workLoad, selection, W::rank(), W::worldSize() }
+    Workers( int workers, int workLoad, int selection,
+             QueuePolicy policy = QueuePolicy::Locked, bool exhaustive = false,
+             int batch = 1, SetPolicy sets = SetPolicy::Shared, int window = 1,
+             StoragePolicy storage = StoragePolicy::Exact ) :
+        _common{ workLoad, selection, W::rank(), W::worldSize(), policy, exhaustive, batch, window,
+                 storage }
     {
+        if ( W::sets( sets ) == SetPolicy::Sharded )
+            _common.shard( workers );
         _workers.reserve( workers );
         for ( int i = 0; i < workers; ++i ) {
             _workers.emplace_back( i, _common );
@@ -273,27 +1278,123 @@ struct Workers {
         if ( W::isMaster( _common ) ) {
             Chunk< Package > ch;
             ch.push( {} );
+            _common.termination().spawned();
             _common.queue().push( std::move( ch ) );
+            _common.termination().initiate();
         }
     }
 
+    // each node appends its phases to `path`.<rank> in the format of
+    // brick::benchmark::ResultLog, benchmarks are prefixed by `name`
+    void results( std::string path, std::string name ) {
+        _results = std::move( path );
+        _name = std::move( name );
+    }
+
     void run() {
+        Phases phases;
+        auto start = Phases::now();
         queueInitials();
+        phases.initials = Phases::since( start );
+
+        auto running = Phases::now();
         for ( auto &w : _workers )
             w.start();
 
-        std::future< void > d = std::async( std::launch::async, [this] {
+        std::future< void > d = std::async( std::launch::async, [this, &phases] {
+            auto start = Phases::now();
             W::dispatcher( _common, _workers );
+            phases.dispatcher = Phases::since( start );
         } );
 
         for ( auto &w : _workers )
             w.wait();
+        phases.run = Phases::since( running );
 
         //_common.done(); it is implied by finishing one of the threads
+        auto notifying = Phases::now();
         W::notifyAll( _common );
+        phases.notify = Phases::since( notifying );
         d.get();
+        W::report( _common );
+        phases.total = Phases::since( start );
+
+        for ( const auto &w : _workers )
+            phases.mains.push_back( w.elapsed() );
+        if ( !_results.empty() )
+            record( phases );
     }
 private:
+    // the x value is the rank, lower and upper bounds equal the value
+    // unless it comes from a sample
+    void record( const Phases &phases ) {
+        using namespace brick::benchmark;
+
+        ResultLog log( _results + "." + std::to_string( _common.rank() ) );
+        ResultLog::Key key;
+        key.p = _common.rank();
+        key.q = _workers.size();
+        auto append = [&]( std::string what, double value ) {
+            key.benchmark = _name + " " + what;
+            log.append( key, ResultLog::Value( key.p, value, value, value ) );
+        };
+
+        append( "initials", phases.initials );
+        if ( !phases.mains.empty() ) {
+            SampleStats stats;
+            stats.sample = phases.mains;
+            stats.processSamples();
+            key.benchmark = _name + " main";
+            log.append( key, ResultLog::Value( key.p, stats.m_mean, stats.b_mean.low, stats.b_mean.high ) );
+        }
+        append( "run", phases.run );
+        append( "dispatcher", phases.dispatcher );
+        append( "notify", phases.notify );
+        append( "total", phases.total );
+
+        double run = std::max( phases.run, 1e-9 );
+        append( "states/s", _common.processed() / run );
+        append( "messages/s", _common.messages() / run );
+
+        const Histogram &latency = _common.latency();
+        if ( latency.count() ) {
+            std::string prefix = "selection " + std::to_string( _common.selection() ) + " latency ";
+            append( prefix + "p50", latency.percentile( 0.5 ) * 1e-9 );
+            append( prefix + "p99", latency.percentile( 0.99 ) * 1e-9 );
+            append( prefix + "p99.9", latency.percentile( 0.999 ) * 1e-9 );
+            append( prefix + "max", latency.max * 1e-9 );
+        }
+    }
+
     std::vector< W > _workers;
     Common< Package > _common;
+    std::string _results;
+    std::string _name;
 };
+
+#ifdef BRICK_UNITTEST_REG
+
+namespace workerTest {
+
+struct Storage {
+
+    // result and the padding are no part of the state, the stores agree on the count
+    TEST(tree) {
+        Set< LongPackage > exact( StoragePolicy::Exact ), tree( StoragePolicy::Tree );
+        exact.setSize( 1024 );
+        LongPackage p;
+        for ( int i = 0; i < 300; ++i ) {
+            p.first = i % 20;
+            p.second = i % 7;
+            p.result = i;
+            exact.insert( p );
+            tree.insert( p );
+        }
+        ASSERT_EQ( exact.stored().states, 140u );
+        ASSERT_EQ( tree.stored().states, exact.stored().states );
+    }
+};
+
+}
+
+#endif
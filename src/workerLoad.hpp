@@ -1,5 +1,6 @@
 #include <future>
 #include <queue>
+#include <functional>
 #include <brick-hashset.h>
 
 #include "daemon.h"
@@ -18,7 +19,30 @@ struct Worker : BaseWorker< S, Package > {
         OutputMessage msg;
         msg.tag( Tag::Done );
 
-        Daemon::instance().sendAll( msg );
+        Daemon::instance().broadcast( msg );
+    }
+
+    // passes Done of `root` on if broadcasting along the tree
+    static void relayDone( int root ) {
+        OutputMessage msg;
+        msg.tag( Tag::Done );
+
+        Daemon::instance().relay( root, msg );
+    }
+
+    // the total is known only when the whole space is explored
+    static void report( Common &common ) {
+        if ( !common.exhaustive() )
+            return;
+        unsigned total = Daemon::instance().reduce( common.processed(), std::plus< unsigned >() );
+        Storage stored = Daemon::instance().reduce( common.stored(), std::plus< Storage >() );
+        if ( isMaster( common ) ) {
+            std::cout << "processed " << total << " packages" << std::endl;
+            std::cout << "stored " << stored.states << " states in "
+                      << ( stored.bytes >> 10 ) << " KiB" << std::endl;
+            if ( common.storage() == StoragePolicy::Fingerprints )
+                std::cout << "probability of an omitted state " << stored.omission << std::endl;
+        }
     }
 
     static bool isMaster( Common &common ) {
@@ -28,18 +52,53 @@ struct Worker : BaseWorker< S, Package > {
     static void dispatcher ( Common &common, const std::vector< Self > & ) {
         Self::init( common );
         while ( !common.quit() ) {
+            // neither gathered messages nor the token may wait for the whole timeout
+            bool hurry = Daemon::instance().coalescing() || common.termination().holding();
+            int timeout = hurry ? 1 : 100;
             int p = Daemon::instance().probe( [&]( Channel channel ) {
                     Self::processDispatch( common, channel );
                 },
                 ChannelType::Master,
-                100
+                timeout
             );
-            if ( p == 0 )
-                Self::flush();
+            Daemon::instance().flush( ChannelType::Master, p != 0 );
+            Self::flush( common, p == 0 ? timeout : 0 );
+            detect( common );
+        }
+    }
+
+    // passes the termination token on once this node is passive
+    static void detect( Common &common ) {
+        Termination::Token token;
+        switch ( common.termination().step( token ) ) {
+        case Termination::Step::Wait:
+            return;
+        case Termination::Step::Terminated:
+            common.done();
+            return;
+        case Termination::Step::Forward:
+            break;
         }
+
+        int next = common.rank() % common.worldSize() + 1;
+        if ( next == common.rank() ) {
+            common.termination().receive( token );
+            return;
+        }
+        OutputMessage msg;
+        msg.tag( Tag::Token );
+        msg << token;
+        Daemon::instance().sendTo( next, msg );
+    }
+
+    static void receiveToken( Common &common, Channel channel ) {
+        InputMessage incoming;
+        Termination::Token token;
+        channel->receiveInto( incoming, &token, 1 );
+        common.termination().receive( token );
     }
     static void init( Common & ) {}
-    static void flush() {}
+    static void flush( Common &, int ) {}
 
     static int rank() {
         return Daemon::instance().rank();
@@ -73,7 +132,8 @@ protected:
         this->progress();
 
         if ( p.first == this->common().workLoad() && p.second == this->common().workLoad() ) {
-            this->done();
+            if ( !this->common().exhaustive() )
+                this->done();
             return;
         }
         expand( p, chID );
@@ -82,16 +142,88 @@ protected:
     void expand( Package p, ChannelID chID ) {
         unsigned o = owner( p );
         if ( o == this->common().rank() ) {
-            if ( this->withTD().insert( p ).isnew() ) {
+            if ( this->sharded() ) {
+                this->termination().spawned();
+                this->shards().route( this->id(), p );
+            }
+            else if ( this->withTD().insert( p ).isnew() ) {
+                this->termination().spawned();
                 this->push( p );
             }
             return;
         }
+        this->self().post( o, p, chID );
+    }
+
+    // sends a package to its owner on another node
+    void post( unsigned o, Package p, ChannelID chID ) {
+        if ( this->common().batch() > 1 )
+            return batch( o, p, chID );
+
         OutputMessage msg;
         msg.tag( Tag::Data );
         msg << p;
+        this->termination().sent();
+        this->sent();
+        Daemon::instance().sendTo( o, msg, chID );
+    }
+
+    // an unsent batch keeps the node active, see Termination
+    void batch( unsigned o, Package p, ChannelID chID ) {
+        if ( _batches.empty() )
+            _batches.resize( this->common().worldSize() + 1,
+                             PackageBatch< Package >( this->common().batch() ) );
+        PackageBatch< Package > &b = _batches[ o ];
+        if ( b.empty() )
+            this->termination().spawned();
+        if ( b.push( p ) )
+            send( o, chID );
+    }
+
+    void send( unsigned o, ChannelID chID ) {
+        PackageBatch< Package > &b = _batches[ o ];
+        OutputMessage msg;
+        msg.tag( Tag::Batch );
+        msg << b.packages();
+        this->termination().sent();
+        this->sent();
         Daemon::instance().sendTo( o, msg, chID );
+        b.clear();
+        this->termination().finished();
     }
+
+    // sends partially filled batches, called when the worker runs out of work
+    void flushBatches( ChannelID chID ) {
+        for ( unsigned o = 0; o < _batches.size(); ++o ) {
+            if ( !_batches[ o ].empty() )
+                send( o, chID );
+        }
+    }
+
+    // inserts the packages which other threads routed to this one
+    void drain() {
+        if ( !this->sharded() )
+            return;
+        this->shards().drain( this->id(), [this]( const Package &p, bool isnew ) {
+            if ( isnew )
+                this->push( p );
+            else
+                this->termination().finished();
+        } );
+    }
+
+    // takes both Tag::Data and Tag::Batch messages
+    static size_t receivePackages( Channel channel, std::vector< Package > &buffer ) {
+        InputMessage incoming;
+        return channel->receiveInto( incoming, buffer.data(), buffer.size() );
+    }
+
+    Self &self() {
+        return *static_cast< Self * >( this );
+    }
+
+private:
+    std::vector< PackageBatch< Package > > _batches;
 };
 
 template< typename Package >
@@ -102,51 +234,84 @@ struct Shared : Worker< Shared, Package > {
     void main() {
 
         while ( !this->quit() ) {
+            this->drain();
             Package p;
             if ( this->pop( p ) ) {
                 this->successors( p, [this]( Package n ) {
                     this->process( n, ChannelType::Master );
                 } );
+                this->termination().finished();
             }
+            else
+                this->flushBatches( ChannelType::Master );
         }
     }
 
     static void init( Common &common ) {
         qa.reset( new QueueAccessor< Package >( common.queue() ) );
+        buffer.resize( common.batch() );
     }
 
     static void processDispatch( Common &common, Channel channel ) {
         static typename Set< Package >::ThreadData td;
 
         InputMessage incoming;
-        Package p;
-        incoming >> p;
-        channel->receive( incoming );
+        channel->peek( incoming );
 
         switch( incoming.tag< Tag >() ) {
         case Tag::Data:
-            if ( common.withTD( td ).insert( p ).isnew() )
-                qa->push( p );
+        case Tag::Batch: {
+            size_t count = Shared::receivePackages( channel, buffer );
+            common.termination().received();
+            if ( common.sharded() ) {
+                for ( size_t i = 0; i < count; ++i ) {
+                    common.termination().spawned();
+                    common.shards().route( common.shards().dispatcher(), buffer[ i ] );
+                }
+            }
+            else {
+                common.withTD( td ).insertBatch( buffer.begin(), buffer.begin() + count,
+                    [&]( const Package &p, typename Set< Package >::iterator it ) {
+                        if ( it.isnew() ) {
+                            common.termination().spawned();
+                            qa->push( p );
+                        }
+                    } );
+            }
+            common.termination().finished();
+        } break;
+        case Tag::Token:
+            Shared::receiveToken( common, channel );
             break;
         case Tag::Done:
+            channel->receiveHeader( incoming );
+            Shared::relayDone( incoming.from() );
             common.done();
             break;
         default:
+            channel->receiveHeader( incoming );
             break;
         }
     }
-    static void flush() {
+    // flushes after 100 ms of idle probing or when the workers starve
+    static void flush( Common &common, int idle ) {
+        if ( common.sharded() )
+            common.shards().flush( common.shards().dispatcher() );
         static int x = 0;
-        if ( ++x == 100 ) {
+        x += idle;
+        if ( x >= 100 || common.queue().empty() ) {
             qa->flush();
             x = 0;
         }
     }
 private:
     static std::unique_ptr< QueueAccessor< Package > > qa;
+    static std::vector< Package > buffer;
 };
 template< typename Package >
 std::unique_ptr< QueueAccessor< Package> > Shared< Package >::qa;
+template< typename Package >
+std::vector< Package > Shared< Package >::buffer;
 
 template< typename Package >
 struct Dedicated : Worker< Dedicated, Package > {
@@ -154,46 +319,200 @@ struct Dedicated : Worker< Dedicated, Package > {
     using Common = Common< Package >;
 
     void main() {
-        std::queue< Package > packages;
+        std::vector< Package > buffer( this->common().batch() );
         while ( !this->quit() ) {
+            this->drain();
             Package p;
             if ( this->pop( p ) ) {
                 this->successors( p, [this]( Package p ) {
                     this->process( p, this->id() );
                 } );
+                this->termination().finished();
             }
+            else
+                this->flushBatches( this->id() );
             Daemon::instance().probe( [&,this]( Channel channel ) {
-                    InputMessage msg;
-                    Package p;
-                    msg >> p;
-                    channel->receive( msg );
-                    packages.push( p );
+                    // the packages were sent here because this node owns them
+                    size_t count = Dedicated::receivePackages( channel, buffer );
+                    this->termination().received();
+                    if ( this->sharded() ) {
+                        for ( size_t i = 0; i < count; ++i ) {
+                            this->termination().spawned();
+                            this->shards().route( this->id(), buffer[ i ] );
+                        }
+                    }
+                    else {
+                        this->withTD().insertBatch( buffer.begin(), buffer.begin() + count,
+                            [this]( const Package &p, typename Set< Package >::iterator it ) {
+                                if ( it.isnew() ) {
+                                    this->termination().spawned();
+                                    this->push( p );
+                                }
+                            } );
+                    }
+                    this->termination().finished();
                 },
                 this->id(),
                 0
             );
-            while ( !packages.empty() ) {
-                this->expand( packages.front(), this->id() );
-                packages.pop();
-            }
+            Daemon::instance().flush( this->id(), true );
         }
     }
 
     void receive( Channel channel ) {
         InputMessage incoming;
         Package p;
-        incoming >> p;
-        channel->receive( incoming );
+        channel->receiveInto( incoming, &p, 1 );
         this->expand( p, this->id() );
     }
 
     static void processDispatch( Common &common, Channel channel ) {
         InputMessage incoming;
+        channel->peek( incoming );
+        if ( incoming.tag< Tag >() == Tag::Token )
+            return Dedicated::receiveToken( common, channel );
+
         channel->receiveHeader( incoming );
-        if ( incoming.tag< Tag >() == Tag::Done )
+        if ( incoming.tag< Tag >() == Tag::Done ) {
+            Dedicated::relayDone( incoming.from() );
             common.done();
+        }
     }
 };
 
 
+
+// workers never touch the sockets: packages for other nodes go to an SPSC
+// ring per destination, which a single I/O thread drains into Tag::Batch
+// messages on data channel 0; the same thread receives the packages and
+// passes them to their owners by hash, see Shards
+template< typename Package >
+struct IO : Worker< IO, Package > {
+    using Worker = Worker< IO::template IO, Package >;
+    using Common = Common< Package >;
+    using Ring = brick::shmem::SpscRing< Package >;
+
+    IO( int id, Common &common ) :
+        Worker{ id, common },
+        _overflow( common.worldSize() + 1 )
+    {
+        for ( int o = 0; o <= common.worldSize(); ++o )
+            _outbox.emplace_back( new Ring( capacity() ) );
+    }
+
+    void main() {
+        while ( !this->quit() ) {
+            this->drain();
+            Package p;
+            if ( this->pop( p ) ) {
+                this->successors( p, [this]( Package n ) {
+                    this->process( n, 0 );
+                } );
+                this->termination().finished();
+            }
+            else
+                flushOutbox();
+        }
+    }
+
+    // the package keeps the node active until the I/O thread sends it
+    void post( unsigned o, Package p, ChannelID ) {
+        this->termination().spawned();
+        Chunk< Package > &overflow = _overflow[ o ];
+        if ( !overflow.empty() || !_outbox[ o ]->push( p ) )
+            overflow.push( p );
+    }
+
+    static SetPolicy sets( SetPolicy ) {
+        return SetPolicy::Sharded;
+    }
+
+    static void dispatcher( Common &common, const std::vector< IO > &workers ) {
+        std::thread io( [&] { relay( common, workers ); } );
+        Worker::dispatcher( common, workers );
+        io.join();
+    }
+
+    static void processDispatch( Common &common, Channel channel ) {
+        InputMessage incoming;
+        channel->peek( incoming );
+        if ( incoming.tag< Tag >() == Tag::Token )
+            return IO::receiveToken( common, channel );
+
+        channel->receiveHeader( incoming );
+        if ( incoming.tag< Tag >() == Tag::Done ) {
+            IO::relayDone( incoming.from() );
+            common.done();
+        }
+    }
+
+private:
+    // packages of one message and of one ring
+    static size_t capacity() {
+        return std::max( size_t( 16 ), size_t( 64 * 1024 ) / sizeof( Package ) );
+    }
+
+    void flushOutbox() {
+        for ( unsigned o = 0; o < _overflow.size(); ++o ) {
+            Chunk< Package > &overflow = _overflow[ o ];
+            while ( !overflow.empty() && _outbox[ o ]->push( overflow.front() ) )
+                overflow.pop();
+        }
+    }
+
+    static void relay( Common &common, const std::vector< IO > &workers ) {
+        std::vector< PackageBatch< Package > > batches(
+            common.worldSize() + 1, PackageBatch< Package >( capacity() ) );
+        std::vector< Package > buffer( capacity() );
+        auto send = [&]( int o ) {
+            PackageBatch< Package > &b = batches[ o ];
+            OutputMessage msg;
+            msg.tag( Tag::Batch );
+            msg << b.packages();
+            common.termination().sent();
+            common.sent();
+            Daemon::instance().sendTo( o, msg, 0 );
+            for ( size_t i = 0; i < b.size(); ++i )
+                common.termination().finished();
+            b.clear();
+        };
+
+        while ( !common.quit() ) {
+            bool idle = true;
+            for ( int o = 1; o <= common.worldSize(); ++o ) {
+                Package p;
+                for ( const IO &w : workers ) {
+                    while ( w._outbox[ o ]->pop( p ) ) {
+                        idle = false;
+                        if ( batches[ o ].push( p ) )
+                            send( o );
+                    }
+                }
+                if ( !batches[ o ].empty() )
+                    send( o );
+            }
+
+            int received = Daemon::instance().probe( [&]( Channel channel ) {
+                    size_t count = IO::receivePackages( channel, buffer );
+                    common.termination().received();
+                    for ( size_t i = 0; i < count; ++i ) {
+                        common.termination().spawned();
+                        common.shards().route( common.shards().dispatcher(), buffer[ i ] );
+                    }
+                    common.termination().finished();
+                },
+                0,
+                0
+            );
+            Daemon::instance().flush( 0, received != 0 );
+            common.shards().flush( common.shards().dispatcher() );
+            if ( idle && !received )
+                std::this_thread::yield();
+        }
+    }
+
+    std::vector< std::unique_ptr< Ring > > _outbox; // by rank of the destination
+    std::vector< Chunk< Package > > _overflow;      // touched by the worker only
+};
+
 }
@@ -77,7 +77,25 @@ struct Worker : BaseWorker< S, Package > {
         OutputMessage msg;
         msg.tag( Tag::Done );
 
-        Daemon::instance().sendAll( msg );
+        Daemon::instance().broadcast( msg );
+    }
+
+    // passes Done of `root` on if broadcasting along the tree
+    static void relayDone( int root, ChannelID chID = ChannelType::Master ) {
+        OutputMessage msg;
+        msg.tag( Tag::Done );
+
+        Daemon::instance().relay( root, msg, chID );
+    }
+
+    // round trips of all nodes
+    static void report( Common< Package > &common ) {
+        Histogram total = Daemon::instance().reduce( common.latency(), []( Histogram h, const Histogram &other ) {
+            h.merge( other );
+            return h;
+        } );
+        if ( common.rank() == Daemon::MainSlave )
+            std::cout << "latency of selection " << common.selection() << ": " << total.summary() << std::endl;
     }
 
     static bool isMaster( Common< Package > &common ) {
@@ -85,13 +103,16 @@ struct Worker : BaseWorker< S, Package > {
     }
 
     static void dispatcher( Common< Package > &common, std::vector< Self > &workers ) {
+        // gathered messages must not wait for the whole timeout
+        int timeout = Daemon::instance().coalescing() ? 1 : 100;
         while ( common.processed() < common.worldSize() ) {
-            Daemon::instance().probe( [&]( Channel channel ) {
+            int p = Daemon::instance().probe( [&]( Channel channel ) {
                     Self::processDispatch( common, workers, channel );
                 },
                 ChannelType::Master,
-                100
+                timeout
             );
+            Daemon::instance().flush( ChannelType::Master, p != 0 );
         }
     }
     static int rank() {
@@ -148,48 +169,19 @@ private:
 };
 
 
-struct Box {
-
-    Box() = default;
-    Box( const Box & ) = delete;
-    Box( Box && ) = delete;
-
-    void signal( int value ) {
-        std::lock_guard< std::mutex > _{ _mutex };
-        _ready = true;
-        _value = value;
-        _cv.notify_one();
-    }
-
-    int wait() {
-        std::unique_lock< std::mutex > guard{ _mutex };
-        _cv.wait( guard, [this] {
-             return _ready;
-        } );
-        _ready = false;
-        return _value;
-    }
-
-private:
-    bool _ready = false;
-    int _value;
-    std::mutex _mutex;
-    std::condition_variable _cv;
-};
-
 template< typename Package >
 struct Shared : Worker< Shared, Package > {
     using Worker = Worker< Shared::template Shared, Package >;
 
     Shared( int id, Common< Package > &common ) :
         Worker{ id, common },
-        _box{ new Box }
+        _roundTrips{ new RoundTrips( common.window() ) }
     {}
     Shared( const Shared & ) = delete;
     Shared( Shared && ) = default;
 
     void push( int v ) {
-        _box->signal( v );
+        _roundTrips->respond( v );
     }
 
     static ChannelID channel( int ) {
@@ -197,7 +189,7 @@ struct Shared : Worker< Shared, Package > {
     }
 
     void main() {
-        for ( int i = 0; i < this->common().workLoad(); ++i ) {
+        _roundTrips->run( this->common().workLoad(), [this]( int i ) {
             OutputMessage msg;
             Package p;
             p.first = i + 13;
@@ -207,31 +199,31 @@ struct Shared : Worker< Shared, Package > {
             msg << p;
             int target = this->owner( p );
 
-            if ( !Daemon::instance().sendTo( target, msg ) )
+            if ( !Daemon::instance().sendTo( target, msg ) ) {
                 std::cout << target << " fail" << std::endl;
-            else {
-                int response = _box->wait();
-
-                if ( response != -p.first )
-                    std::cout << response << " != " << -p.first << std::endl;
+                return 0;
             }
-        }
+            this->sent();
+            return p.first;
+        }, _latency );
+        this->latency( _latency );
     }
 
     static void processDispatch( Common< Package > &common, std::vector< Shared > &workers, Channel channel ) {
         Package p;
         InputMessage incoming;
-        incoming >> p;
-        channel->receive( incoming );
+        channel->receiveInto( incoming, &p, 1 );
 
         switch ( incoming.tag< Tag >() ) {
         case Tag::Request:
             Worker::request( incoming.from(), p );
+            common.sent();
             break;
         case Tag::Response:
             workers[ p.second ].push( p.first );
             break;
         case Tag::Done:
+            Worker::relayDone( incoming.from() );
             common.progress();
             break;
         default:
@@ -239,14 +231,19 @@ struct Shared : Worker< Shared, Package > {
         }
     }
 private:
-    std::unique_ptr< Box > _box;
+    std::unique_ptr< RoundTrips > _roundTrips;
+    Histogram _latency;
 };
 
 template< typename Package >
 struct Dedicated : Worker< Dedicated, Package > {
     using Worker = Worker< Dedicated::template Dedicated, Package >;
 
-    using Worker::Worker;
+    Dedicated( int id, Common< Package > &common ) :
+        Worker{ id, common },
+        _asked( common.window() ),
+        _answered( common.window(), false )
+    {}
 
     static ChannelID channel( int ch ) {
         return ch;
@@ -256,6 +253,7 @@ struct Dedicated : Worker< Dedicated, Package > {
         ask();
 
         while ( _finished < this->common().worldSize() ) {
+            Daemon::instance().flush( this->id() );
             Daemon::instance().probe( [&,this]( Channel channel ) {
                     processMessage( channel );
                 },
@@ -263,6 +261,7 @@ struct Dedicated : Worker< Dedicated, Package > {
                 -1
             );
         }
+        this->latency( _latency );
     }
 
     static void processDispatch( Common< Package > &common, std::vector< Dedicated > &, Channel channel ) {
@@ -271,6 +270,7 @@ struct Dedicated : Worker< Dedicated, Package > {
 
         switch ( incoming.tag< Tag >() ) {
         case Tag::Done:
+            Worker::relayDone( incoming.from() );
             common.progress();
             break;
         default:
@@ -282,35 +282,55 @@ private:
         InputMessage msg;
         Package p;
 
-        msg >> p;
-        channel->receive( msg );
+        channel->receiveInto( msg, &p, 1 );
 
         switch ( msg.tag< Tag >() ) {
         case Tag::Request:
             response( channel, p );
             break;
         case Tag::Response:
-            if ( -p.first == this->common().workLoad() )
+            answered( -p.first );
+            if ( _oldest > this->common().workLoad() )
                 finish();
             else
                 ask();
             break;
         case Tag::Done:
+            Worker::relayDone( msg.from(), this->id() );
             ++_finished;
             break;
         default:
             break;
         }
     }
+    // the first of a package is its sequence number; requests are asked
+    // while they fit into the window following the oldest unanswered one
     void ask() {
-        OutputMessage msg;
-        Package p;
-        p.first = ++_processing;
+        int window = _asked.size();
+        while ( _next <= this->common().workLoad() && _next < _oldest + window ) {
+            OutputMessage msg;
+            Package p;
+            p.first = _next++;
 
-        msg.tag( Tag::Request );
-        msg << p;
+            msg.tag( Tag::Request );
+            msg << p;
 
-        Daemon::instance().sendTo( this->owner( p ), msg, this->id() );
+            _asked[ p.first % window ] = Phases::now();
+            Daemon::instance().sendTo( this->owner( p ), msg, this->id() );
+            this->sent();
+        }
+    }
+    // responses come in any order as the requests go to different peers
+    void answered( int sequence ) {
+        int window = _asked.size();
+        if ( sequence < _oldest || sequence >= _next || _answered[ sequence % window ] ) {
+            std::cout << "unexpected response " << sequence << std::endl;
+            return;
+        }
+        _latency.record( _asked[ sequence % window ] );
+        _answered[ sequence % window ] = true;
+        for ( ; _oldest < _next && _answered[ _oldest % window ]; ++_oldest )
+            _answered[ _oldest % window ] = false;
     }
     void response( Channel channel, Package p ) {
         OutputMessage msg;
@@ -319,17 +339,22 @@ private:
 
         msg << p;
         channel->send( msg );
+        this->sent();
     }
     void finish() {
         ++_finished;
         OutputMessage msg;
         msg.tag( Tag::Done );
 
-        Daemon::instance().sendAll( msg, this->id() );
+        Daemon::instance().broadcast( msg, this->id() );
     }
 
     int _finished = 0;
-    int _processing = 0;
+    int _next = 1;   // sequence number of the next request
+    int _oldest = 1; // the oldest unanswered request
+    std::vector< Phases::Clock::time_point > _asked;
+    std::vector< bool > _answered;
+    Histogram _latency;
 };
 
 } // namespace ping